@@ -21,10 +21,10 @@
 #include <fstream>
 #include <cmath>
 
-#include <ef.gy/cli.h>
 #include <ef.gy/version.h>
 #include <ef.gy/parametric.h>
 
+#include <topologic/options.h>
 #include <topologic/parse.h>
 #include <topologic/version.h>
 
@@ -39,13 +39,21 @@ namespace topologic {
  *
  * As usual, later options override earlier ones - that also applies to
  * settings in XML files. If the NOLIBRARIES macro is set then XML files
- * will not be processed.
+ * will not be processed. Files are read in parallel, but their settings are
+ * still applied in the order the files were given in.
  *
  * \tparam Q   Base data type as used in the topologic::state instance
  * \tparam dim Maximum render depth of the topologic::state instance
  *
+ * The options are compiled into a set that belongs to the call, so nothing
+ * is shared between calls and it is safe to parse several argument vectors
+ * at the same time, e.g. in different threads, as long as each one is
+ * applied to a different topologic::state instance.
+ *
  * \param[out] topologicState The topologic::state instance to populate
  * \param[in]  args           Command line argument vector.
+ * \param[out] remainder      The arguments that weren't recognised as
+ *                            options, in the order they were given in.
  * \param[in]  readFiles      Try to treat unrecognised options as files.
  *
  * \returns The output mode set in the argument vector. Defaults to outNone.
@@ -53,17 +61,16 @@ namespace topologic {
 template <typename Q, std::size_t dim>
 enum outputMode parse(state<Q, dim> &topologicState,
                       const std::vector<std::string> &args,
+                      std::vector<std::string> &remainder,
                       bool readFiles = true) {
   enum outputMode out = outNone;
+  options set;
 
-#if !defined(NOLIBRARIES)
-  topologic::xml XML;
-#endif
   std::size_t depth = 4, rdepth = 4;
   std::string model = "cube";
   std::string format = "cartesian";
 
-  efgy::cli::option oversion("-{0,2}version", [](std::smatch &)->bool {
+  option oversion("-{0,2}version", [](option::match &)->bool {
     std::cout << "Topologic/V" << version << "\n"
                                              "libefgy/V" << efgy::version
               << "\n"
@@ -87,11 +94,18 @@ enum outputMode parse(state<Q, dim> &topologicState,
     std::cout << "\n";
     return true;
   },
-                             "Print version information.");
+                  "Print version information.", set);
+
+  option ohelp("-{0,2}help", [&set](option::match &)->bool {
+    std::cout << "Usage: topologic [OPTION]... [FILE]...\n\n"
+                 "Options:\n";
+    return set.help(std::cout);
+  },
+               "Print this help text.", set);
 
-  efgy::cli::option omodel(
+  option omodel(
       "-{0,2}m(odel)?:([0-9]+)-([a-z-]+)(@([0-9]+))?(:([a-z]+))?",
-      [&depth, &rdepth, &model, &format](std::smatch & m)->bool {
+      [&depth, &rdepth, &model, &format](option::match &m)->bool {
     depth = std::stoi(m[2]);
     model = m[3];
     if (m[5] != "") {
@@ -103,26 +117,141 @@ enum outputMode parse(state<Q, dim> &topologicState,
     return true;
   },
       "Sets all the model type parameters. The form is: D-MODEL[@R][:FORMAT], "
-      "e.g. 3-cube@4:polar. The default is 4-cube@4:cartesian.");
+      "e.g. 3-cube@4:polar. The default is 4-cube@4:cartesian.", set);
 
-  efgy::cli::option oformat("-{0,2}(none|json|svg|arguments)",
-                            [&out](std::smatch & m)->bool {
+  option oformat("-{0,2}(none|json(:geometry(:raw)?)?|"
+                 "svg(:animated)?|arguments|glb|raw|png|ppm|rgba)",
+                 [&out](option::match &m)->bool {
     if (m[1] == "json") {
       out = topologic::outJSON;
+    } else if (m[1] == "json:geometry") {
+      out = topologic::outJSONGeometry;
+    } else if (m[1] == "json:geometry:raw") {
+      out = topologic::outJSONRawGeometry;
     } else if (m[1] == "svg") {
       out = topologic::outSVG;
+    } else if (m[1] == "svg:animated") {
+      out = topologic::outSVGAnimation;
     } else if (m[1] == "arguments") {
       out = topologic::outArguments;
+    } else if (m[1] == "glb") {
+      out = topologic::outGLB;
+    } else if (m[1] == "raw") {
+      out = topologic::outRaw;
+    } else if (m[1] == "png") {
+      out = topologic::outPNG;
+    } else if (m[1] == "ppm") {
+      out = topologic::outPPM;
+    } else if (m[1] == "rgba") {
+      out = topologic::outRGBA;
     } else {
       out = topologic::outNone;
     }
     return true;
   },
-                            "Select an output format.");
+                 "Select an output format. The rgba format writes raw "
+                 "RGBA pixels, a frame at a time, e.g. for ffmpeg's "
+                 "'-f rawvideo -pix_fmt rgba -s WIDTHxHEIGHT' input.",
+                 set);
+
+  option osize("-{0,2}size:([0-9]+):([0-9]+)",
+               [&topologicState](option::match &m)->bool {
+    const Q width = Q(std::stold(m[1]));
+    const Q height = Q(std::stold(m[2]));
+    if ((width < Q(1)) || (height < Q(1))) {
+      return false;
+    }
+    topologicState.width = width;
+    topologicState.height = height;
+    return true;
+  },
+               "Set the size of bitmap output, in pixels. The form "
+               "is: size:WIDTH:HEIGHT. The default is 512x512.", set);
+
+  option osamples("-{0,2}samples:(1|4|8)",
+                  [&topologicState](option::match &m)->bool {
+    topologicState.multisample = std::stoul(m[1]);
+    return true;
+  },
+                  "Set the number of samples per pixel for bitmap "
+                  "output. The default is 4.", set);
+
+  option olighting("-{0,2}lighting",
+                   [&topologicState](option::match &)->bool {
+    topologicState.lighting = true;
+    return true;
+  },
+                   "Depth test and light surfaces in bitmap output, "
+                   "like the OpenGL renderer does.", set);
+
+  option oorderIndependent(
+      "-{0,2}order-independent", [&topologicState](option::match &)->bool {
+    topologicState.orderIndependent = true;
+    return true;
+  },
+      "Blend translucent surfaces in bitmap output independently of the order "
+      "they are drawn in.", set);
+
+  option odepthSort("-{0,2}depth-sort",
+                    [&topologicState](option::match &)->bool {
+    topologicState.depthSort = true;
+    return true;
+  },
+                    "Draw faces in bitmap output from back to "
+                    "front.", set);
+
+  option oflameSamples(
+      "-{0,2}flame-samples:([0-9]+)",
+      [&topologicState](option::match &m)->bool {
+    topologicState.flameSamples = std::stoul(m[1]);
+    return true;
+  },
+      "Set the number of samples per pixel for bitmap output with fractal "
+      "flame colouring. The default is 32.", set);
+
+  option oflameCheckpoint(
+      "-{0,2}flame-checkpoint:(.+)",
+      [&topologicState](option::match &m)->bool {
+    topologicState.flameCheckpoint = m[1];
+    return true;
+  },
+      "Save the progress of fractal flame bitmap output to a file, and resume "
+      "from that file if it exists. A preview image is written to the same "
+      "file name with .png appended whenever the samples per pixel reach a "
+      "power of two.", set);
+
+  option oanimate(
+      "-{0,2}animate:([0-9]+)((:[0-9]+:-?[0-9.]+:-?[0-9.]+)*)",
+      [&topologicState](option::match &m)->bool {
+    std::istringstream s(m[2]);
+    std::string coord;
+    std::vector<Q> v;
+
+    while (std::getline(s, coord, ':')) {
+      if (coord != "") {
+        v.push_back(Q(std::stold(coord)));
+      }
+    }
+
+    topologicState.frames = std::stoul(m[1]);
+    topologicState.motion.clear();
+    for (std::size_t i = 0; i + 2 < v.size(); i += 3) {
+      topologicState.motion.push_back({{v[i], v[i + 1], v[i + 2]}});
+    }
+    if (topologicState.motion.empty()) {
+      topologicState.motion.push_back({{Q(4), Q(-2), Q(0)}});
+      topologicState.motion.push_back({{Q(3), Q(0), Q(1)}});
+    }
+    return true;
+  },
+      "Render an animation for raw RGBA or animated SVG output. The form is: "
+      "animate:FRAMES[:DIMENSION:X:Y]..., where each DIMENSION:X:Y is a drag "
+      "that is applied to that dimension before every frame. The default "
+      "motion rotates in 4D and 3D, like the screen saver does.", set);
 
-  efgy::cli::option oifs(
+  option oifs(
       "-{0,2}r(andom)?:([0-9]+)(:([0-9]+))?(:([0-9]+))?(:pre)?(:post)?",
-      [&topologicState](std::smatch & m)->bool {
+      [&topologicState](option::match &m)->bool {
     topologicState.state<Q, 2>::parameter.seed = Q(std::stold(m[2]));
     if (m[4] != "") {
       topologicState.state<Q, 2>::parameter.functions = Q(std::stold(m[4]));
@@ -137,13 +266,13 @@ enum outputMode parse(state<Q, dim> &topologicState,
   },
       "Set parameters for randomised models. The order of the arguments is: "
       "seed[:functions][:variants][:pre][:post]. Only the seed is required to "
-      "be set.");
+      "be set.", set);
 
-  efgy::cli::option ocolour("-{0,2}colour(:fractal-flame|"
-                            "(:b:([0-9.]+):([0-9.]+):([0-9.]+):([0-9.]+))?"
-                            "(:w:([0-9.]+):([0-9.]+):([0-9.]+):([0-9.]+))?"
-                            "(:s:([0-9.]+):([0-9.]+):([0-9.]+):([0-9.]+))?)",
-                            [&topologicState](std::smatch & m)->bool {
+  option ocolour("-{0,2}colour(:fractal-flame|"
+                 "(:b:([0-9.]+):([0-9.]+):([0-9.]+):([0-9.]+))?"
+                 "(:w:([0-9.]+):([0-9.]+):([0-9.]+):([0-9.]+))?"
+                 "(:s:([0-9.]+):([0-9.]+):([0-9.]+):([0-9.]+))?)",
+                 [&topologicState](option::match &m)->bool {
     topologicState.state<Q, 2>::fractalFlameColouring =
         (m[1] == ":fractal-flame");
     if (m[2] != "") {
@@ -166,21 +295,21 @@ enum outputMode parse(state<Q, dim> &topologicState,
     }
     return true;
   },
-                            "Set the colour scheme to use.");
+                 "Set the colour scheme to use.", set);
 
-  efgy::cli::option oradius("-{0,2}(R|radius):([0-9.]+)(:([0-9.]+))?",
-                            [&topologicState](std::smatch & m)->bool {
+  option oradius("-{0,2}(R|radius):([0-9.]+)(:([0-9.]+))?",
+                 [&topologicState](option::match &m)->bool {
     topologicState.state<Q, 2>::parameter.radius = Q(std::stold(m[2]));
     if (m[4] != "") {
       topologicState.state<Q, 2>::parameter.radius2 = Q(std::stold(m[4]));
     }
     return true;
   },
-                            "Set the radii used in some formulas.");
+                 "Set the radii used in some formulas.", set);
 
-  efgy::cli::option oparam(
+  option oparam(
       "-{0,2}(p|precision|c|constant):([0-9.]+)",
-      [&topologicState](std::smatch & m)->bool {
+      [&topologicState](option::match &m)->bool {
     if ((m[1] == "precision") || (m[1] == "p")) {
       topologicState.state<Q, 2>::parameter.precision = Q(std::stold(m[2]));
     } else if ((m[1] == "constant") || (m[1] == "c")) {
@@ -188,19 +317,19 @@ enum outputMode parse(state<Q, dim> &topologicState,
     }
     return true;
   },
-      "Set the precision, or the constant factor for some formulae.");
+      "Set the precision, or the constant factor for some formulae.", set);
 
-  efgy::cli::option oiterations(
+  option oiterations(
       "-{0,2}(i|iterations):([0-9]+)",
-      [&topologicState](std::smatch & m)->bool {
+      [&topologicState](option::match &m)->bool {
     topologicState.state<Q, 2>::parameter.iterations = Q(std::stoll(m[2]));
     return true;
   },
-      "Set the number of iterations for iterative formulae.");
+      "Set the number of iterations for iterative formulae.", set);
 
-  efgy::cli::option ofrom(
+  option ofrom(
       "-{0,2}f(rom)?((:[0-9.]+){2,})(:polar)?",
-      [&topologicState](std::smatch & m)->bool {
+      [&topologicState](option::match &m)->bool {
     topologicState.state<Q, 2>::polarCoordinates = (m[4] == ":polar");
     std::istringstream s(m[2]);
     std::string coord;
@@ -220,11 +349,11 @@ enum outputMode parse(state<Q, dim> &topologicState,
   },
       "Set a from point of the transformation. Which of the from points is set "
       "depends on the number of coordinates given. The polar suffix treats the "
-      "input as polar coordinates.");
+      "input as polar coordinates.", set);
 
-  efgy::cli::option otransform(
+  option otransform(
       "-{0,2}t(ransform)?((:[0-9.]+){2,})",
-      [&topologicState](std::smatch & m)->bool {
+      [&topologicState](option::match &m)->bool {
     std::istringstream s(m[2]);
     std::string coord;
     std::vector<Q> v;
@@ -250,29 +379,14 @@ enum outputMode parse(state<Q, dim> &topologicState,
     return true;
   },
       "Set a tranformation matrix. Which of the matrices is set depends on the "
-      "number of coordinates given.");
+      "number of coordinates given.", set);
 
-  efgy::cli::options<>::common().apply(args);
+  set.apply(args);
+  remainder = set.remainder;
 
   if (readFiles) {
-    for (const auto &f : efgy::cli::options<>::common().remainder) {
-      std::ifstream in(f);
-      std::istreambuf_iterator<char> eos;
-      std::string s(std::istreambuf_iterator<char>(in), eos);
-
-#if !defined(NOLIBRARIES)
-      xml::parser p(s, f);
-      if (p.valid) {
-        parse(topologicState, p);
-        parseModel<Q, dim, updateModel>(topologicState, p);
-      } else
-#endif
-          {
-        efgy::json::value<> v;
-        s >> v;
-        parse(topologicState, v);
-        parseModel<Q, dim, updateModel>(topologicState, v);
-      }
+    for (auto &doc : document::load(remainder)) {
+      doc->apply<Q, dim, updateModel>(topologicState);
 
       if (topologicState.model) {
         format = topologicState.model->formatID;
@@ -294,6 +408,28 @@ enum outputMode parse(state<Q, dim> &topologicState,
 
   return out;
 }
+
+/**\brief Parse command line arguments
+ *
+ * Like the other variant of topologic::parse(), but for callers that don't
+ * need the arguments that weren't recognised as options.
+ *
+ * \tparam Q   Base data type as used in the topologic::state instance
+ * \tparam dim Maximum render depth of the topologic::state instance
+ *
+ * \param[out] topologicState The topologic::state instance to populate
+ * \param[in]  args           Command line argument vector.
+ * \param[in]  readFiles      Try to treat unrecognised options as files.
+ *
+ * \returns The output mode set in the argument vector. Defaults to outNone.
+ */
+template <typename Q, std::size_t dim>
+enum outputMode parse(state<Q, dim> &topologicState,
+                      const std::vector<std::string> &args,
+                      bool readFiles = true) {
+  std::vector<std::string> remainder;
+  return parse(topologicState, args, remainder, readFiles);
+}
 }
 
 #endif
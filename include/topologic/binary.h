@@ -0,0 +1,181 @@
+/**\file
+ * \brief Binary output helpers
+ *
+ * Some of Topologic's output formats are binary rather than text, and these
+ * formats tend to insist on a specific byte order - typically little endian.
+ * This file contains the few helpers needed to produce such output, and to
+ * read it back in, regardless of the host's native byte order.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_BINARY_H)
+#define TOPOLOGIC_BINARY_H
+
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+namespace topologic {
+/**\brief Binary output helpers
+ *
+ * Contains functions to write integers and floating point values to output
+ * streams with a well-defined byte order, and to read them back in.
+ */
+namespace binary {
+/**\brief Is the host little endian?
+ *
+ * Used to decide whether data can be written straight from memory or whether
+ * it needs to be byte-swapped first.
+ *
+ * \returns 'true' if the host uses little endian byte order.
+ */
+static inline bool littleEndian(void) {
+  const std::uint16_t probe = 1;
+  return *((const unsigned char *)&probe) == 1;
+}
+
+/**\brief Write little endian value
+ *
+ * Writes the given integer or floating point value to the output stream in
+ * little endian byte order.
+ *
+ * \tparam T Type of the value to write; should be a plain arithmetic type.
+ *
+ * \param[out] output The stream to write to.
+ * \param[in]  value  The value to write.
+ *
+ * \returns The output stream.
+ */
+template <typename T>
+static inline std::ostream &put(std::ostream &output, const T &value) {
+  unsigned char bytes[sizeof(T)];
+  std::memcpy(bytes, &value, sizeof(T));
+  if (!littleEndian()) {
+    for (std::size_t i = 0; i < sizeof(T) / 2; i++) {
+      const unsigned char c = bytes[i];
+      bytes[i] = bytes[sizeof(T) - 1 - i];
+      bytes[sizeof(T) - 1 - i] = c;
+    }
+  }
+  return output.write((const char *)bytes, sizeof(T));
+}
+
+/**\brief Write little endian array
+ *
+ * Writes all the values in the given vector to the output stream in little
+ * endian byte order. On little endian hosts this is a single write.
+ *
+ * \tparam T Type of the values to write.
+ *
+ * \param[out] output The stream to write to.
+ * \param[in]  values The values to write.
+ *
+ * \returns The output stream.
+ */
+template <typename T>
+static inline std::ostream &put(std::ostream &output,
+                                const std::vector<T> &values) {
+  if (littleEndian()) {
+    return output.write((const char *)values.data(),
+                        values.size() * sizeof(T));
+  }
+  for (const T &value : values) {
+    put(output, value);
+  }
+  return output;
+}
+
+/**\brief Read little endian value
+ *
+ * Reads an integer or floating point value that was written with put().
+ *
+ * \tparam T Type of the value to read; should be a plain arithmetic type.
+ *
+ * \param[in]  input The stream to read from.
+ * \param[out] value The value that was read.
+ *
+ * \returns The input stream.
+ */
+template <typename T>
+static inline std::istream &get(std::istream &input, T &value) {
+  unsigned char bytes[sizeof(T)];
+  if (input.read((char *)bytes, sizeof(T)) && !littleEndian()) {
+    for (std::size_t i = 0; i < sizeof(T) / 2; i++) {
+      const unsigned char c = bytes[i];
+      bytes[i] = bytes[sizeof(T) - 1 - i];
+      bytes[sizeof(T) - 1 - i] = c;
+    }
+  }
+  std::memcpy(&value, bytes, sizeof(T));
+  return input;
+}
+
+/**\brief Read little endian array
+ *
+ * Reads as many values as the given vector holds, as written with put().
+ *
+ * \tparam T Type of the values to read.
+ *
+ * \param[in]  input  The stream to read from.
+ * \param[out] values The values that were read; must already have the
+ *                    right size.
+ *
+ * \returns The input stream.
+ */
+template <typename T>
+static inline std::istream &get(std::istream &input, std::vector<T> &values) {
+  if (littleEndian()) {
+    return input.read((char *)values.data(), values.size() * sizeof(T));
+  }
+  for (T &value : values) {
+    get(input, value);
+  }
+  return input;
+}
+
+/**\brief Write padding
+ *
+ * Writes the given byte to the output stream until 'length' is a multiple of
+ * 'alignment'.
+ *
+ * \param[out] output    The stream to write to.
+ * \param[in]  length    Number of bytes written so far.
+ * \param[in]  alignment The required alignment, in bytes.
+ * \param[in]  byte      The padding byte to use.
+ *
+ * \returns The output stream.
+ */
+static inline std::ostream &pad(std::ostream &output, std::size_t length,
+                                std::size_t alignment, char byte = 0) {
+  for (; (length % alignment) != 0; length++) {
+    output.put(byte);
+  }
+  return output;
+}
+
+/**\brief Padded length
+ *
+ * Calculates how long a block of data will be after it has been padded to
+ * the given alignment.
+ *
+ * \param[in] length    Unpadded length of the data, in bytes.
+ * \param[in] alignment The required alignment, in bytes.
+ *
+ * \returns The padded length of the data, in bytes.
+ */
+static inline std::size_t padded(std::size_t length, std::size_t alignment) {
+  return (length + alignment - 1) / alignment * alignment;
+}
+}
+}
+
+#endif
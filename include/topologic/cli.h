@@ -63,13 +63,38 @@ template <typename FP> int cli(int argc, char *argv[]) {
   }
 
   enum outputMode out = parse(topologicState, args);
+  bool ok = true;
 
   if (!topologicState.model) {
     std::cerr << "error: no model to render\n";
+    ok = false;
   } else if (out == outSVG) {
     std::cout << efgy::svg::tag() << topologicState;
   } else if (out == outJSON) {
     std::cout << efgy::json::tag() << topologicState;
+  } else if (out == outJSONGeometry) {
+    ok = topologicState.model->json(std::cout, true, true);
+  } else if (out == outJSONRawGeometry) {
+    ok = topologicState.model->json(std::cout, false, true);
+  } else if (out == outGLB) {
+    ok = topologicState.model->glb(std::cout, true);
+  } else if (out == outRaw) {
+    ok = topologicState.model->raw(std::cout);
+  } else if (out == outPNG) {
+    ok = topologicState.model->raster(std::cout, image::formatPNG, true);
+  } else if (out == outPPM) {
+    ok = topologicState.model->raster(std::cout, image::formatPPM, true);
+  } else if (out == outRGBA) {
+    const std::size_t frames =
+        std::max<std::size_t>(1, topologicState.frames);
+    for (std::size_t i = 0; ok && (i < frames); i++) {
+      if (i > 0) {
+        topologicState.advance();
+      }
+      ok = topologicState.model->raster(std::cout, image::formatRGBA, true);
+    }
+  } else if (out == outSVGAnimation) {
+    ok = topologicState.model->smil(std::cout);
   } else if (out == outArguments) {
     std::vector<std::string> v;
     std::cout << "topologic";
@@ -79,7 +104,9 @@ template <typename FP> int cli(int argc, char *argv[]) {
     std::cout << "\n";
   }
 
-  return 0;
+  // output that couldn't be written is as much of a failure as a model
+  // that couldn't be rendered, e.g. if the output is piped somewhere.
+  return (ok && std::cout.flush()) ? 0 : 1;
 }
 }
 
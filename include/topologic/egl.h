@@ -0,0 +1,278 @@
+/**\file
+ * \brief Headless OpenGL frontend
+ *
+ * Contains a CLI frontend that renders bitmaps with the OpenGL renderer, the
+ * same one the desktop and iOS frontends use, instead of the software
+ * rasteriser. It doesn't need a window system: the OpenGL context is created
+ * with EGL, on Mesa's surfaceless platform if that is available, so it works
+ * on headless servers and with software implementations like llvmpipe.
+ *
+ * The renderer draws to the default framebuffer, so the context is given an
+ * offscreen pbuffer surface of the requested image size to draw to, and the
+ * image is read back from that once a frame is complete.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ * \see EGL Specification: https://www.khronos.org/registry/EGL/
+ */
+
+#if !defined(TOPOLOGIC_EGL_H)
+#define TOPOLOGIC_EGL_H
+
+#include <topologic/arguments.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstdint>
+#include <vector>
+
+#if !defined(MAXDEPTH)
+/**\brief Maximum render depth
+ *
+ * See the CLI frontend for details; the default value is the same as there.
+ */
+#define MAXDEPTH 7
+#endif
+
+namespace topologic {
+/**\brief Headless OpenGL context
+ *
+ * Sets up an OpenGL 3.2 core profile context - the profile the desktop
+ * frontend uses - with an offscreen surface, and makes it current. The
+ * context is destroyed when the object goes out of scope.
+ */
+class eglContext {
+public:
+  /**\brief Create context
+   *
+   * \param[in] pWidth  Width of the surface to draw to, in pixels.
+   * \param[in] pHeight Height of the surface to draw to, in pixels.
+   */
+  eglContext(std::size_t pWidth, std::size_t pHeight)
+      : width(pWidth), height(pHeight), ready(false), display(EGL_NO_DISPLAY),
+        surface(EGL_NO_SURFACE), context(EGL_NO_CONTEXT) {
+#if defined(EGL_PLATFORM_SURFACELESS_MESA)
+    const auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)
+        eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay) {
+      display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA,
+                                   EGL_DEFAULT_DISPLAY, 0);
+    }
+#endif
+    if (display == EGL_NO_DISPLAY) {
+      display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (display == EGL_NO_DISPLAY || !eglInitialize(display, 0, 0)) {
+      display = EGL_NO_DISPLAY;
+      return;
+    }
+
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE,     8,               EGL_GREEN_SIZE,      8,
+        EGL_BLUE_SIZE,    8,               EGL_ALPHA_SIZE,      8,
+        EGL_DEPTH_SIZE,   24,              EGL_NONE};
+    EGLConfig config;
+    EGLint configs = 0;
+    if (!eglChooseConfig(display, configAttributes, &config, 1, &configs) ||
+        configs < 1) {
+      return;
+    }
+
+    const EGLint surfaceAttributes[] = {EGL_WIDTH, EGLint(width), EGL_HEIGHT,
+                                        EGLint(height), EGL_NONE};
+    surface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+    if (surface == EGL_NO_SURFACE || !eglBindAPI(EGL_OPENGL_API)) {
+      return;
+    }
+
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION,
+        3,
+        EGL_CONTEXT_MINOR_VERSION,
+        2,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK,
+        EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE};
+    context =
+        eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT) {
+      return;
+    }
+
+    ready = eglMakeCurrent(display, surface, surface, context);
+  }
+
+  /**\brief Destroy context
+   *
+   * Releases the context and its surface, then the display connection.
+   */
+  ~eglContext(void) {
+    if (display == EGL_NO_DISPLAY) {
+      return;
+    }
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (context != EGL_NO_CONTEXT) {
+      eglDestroyContext(display, context);
+    }
+    if (surface != EGL_NO_SURFACE) {
+      eglDestroySurface(display, surface);
+    }
+    eglTerminate(display);
+  }
+
+  /**\brief Read back pixels
+   *
+   * Waits for all pending OpenGL commands to complete, then copies the image
+   * from the surface. OpenGL stores images bottom row first, so the rows are
+   * flipped to match what the image writers expect.
+   *
+   * \param[out] pixels RGBA values of the image's pixels, row by row,
+   *                    starting at the top left corner.
+   */
+  void read(std::vector<std::uint8_t> &pixels) const {
+    const std::size_t stride = width * 4;
+    std::vector<std::uint8_t> rows(stride * height);
+
+    glFinish();
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, GLsizei(width), GLsizei(height), GL_RGBA,
+                 GL_UNSIGNED_BYTE, rows.data());
+
+    pixels.resize(stride * height);
+    for (std::size_t y = 0; y < height; y++) {
+      std::copy(rows.begin() + (height - 1 - y) * stride,
+                rows.begin() + (height - y) * stride,
+                pixels.begin() + y * stride);
+    }
+  }
+
+  /**\brief Surface width
+   *
+   * Width of the offscreen surface, in pixels.
+   */
+  const std::size_t width;
+
+  /**\brief Surface height
+   *
+   * Height of the offscreen surface, in pixels.
+   */
+  const std::size_t height;
+
+  /**\brief Is the context usable?
+   *
+   * 'true' if the context was created successfully and is current.
+   */
+  bool ready;
+
+protected:
+  /**\brief EGL display
+   *
+   * The display connection the context was created on.
+   */
+  EGLDisplay display;
+
+  /**\brief EGL surface
+   *
+   * The offscreen pbuffer that the context draws to.
+   */
+  EGLSurface surface;
+
+  /**\brief EGL context
+   *
+   * The OpenGL context itself.
+   */
+  EGLContext context;
+};
+
+/**\brief Headless OpenGL frontend main function
+ *
+ * Main function for a CLI frontend that writes bitmaps rendered with OpenGL
+ * to stdout. It accepts the same arguments as the basic CLI frontend, but
+ * only supports the bitmap output formats; PNG is used if no format is set.
+ *
+ * \tparam FP Floating point data type to use; something like double
+ *
+ * \param[in] argc The number of arguments that are being passed in argv.
+ * \param[in] argv The actual argument vector. The first element must be
+ *                 the name the programme was called as, the remainder are
+ *                 command line flags.
+ *
+ * \returns 0 if the function ran correctly, nonzero otherwise.
+ */
+template <typename FP> int egl(int argc, char *argv[]) {
+  state<FP, MAXDEPTH> topologicState;
+  std::vector<std::string> args;
+
+  for (std::size_t i = 0; i < argc; i++) {
+    args.push_back(argv[i]);
+  }
+
+  enum outputMode out = parse(topologicState, args);
+
+  enum image::format type = image::formatPNG;
+  if (out == outPPM) {
+    type = image::formatPPM;
+  } else if (out == outRGBA) {
+    type = image::formatRGBA;
+  } else if (out != outNone && out != outPNG) {
+    std::cerr << "error: only bitmap output is supported\n";
+    return 1;
+  }
+
+  if (!topologicState.model) {
+    std::cerr << "error: no model to render\n";
+    return 1;
+  }
+
+  eglContext context(std::size_t(topologicState.width),
+                     std::size_t(topologicState.height));
+  if (!context.ready) {
+    std::cerr << "error: could not create an OpenGL context\n";
+    return 1;
+  }
+
+  glEnable(GL_BLEND);
+  glDisable(GL_CULL_FACE);
+  glViewport(0, 0, GLsizei(context.width), GLsizei(context.height));
+
+  // as in the desktop frontend, the renderer has to draw a frame before the
+  // colour map can be set, as the first frame sets up a random one.
+  if (topologicState.fractalFlameColouring) {
+    topologicState.model->opengl(true);
+    topologicState.opengl.setColourMap(topologicState.parameter.colourMap);
+  }
+
+  std::vector<std::uint8_t> pixels;
+  const std::size_t frames =
+      type == image::formatRGBA
+          ? std::max<std::size_t>(1, topologicState.frames)
+          : 1;
+  for (std::size_t i = 0; i < frames; i++) {
+    if (i > 0) {
+      topologicState.advance();
+    }
+
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    if (!topologicState.model->opengl(true)) {
+      return 1;
+    }
+    context.read(pixels);
+
+    if (!image::write(std::cout, type, context.width, context.height,
+                      pixels)) {
+      return 1;
+    }
+  }
+
+  return 0;
+}
+}
+
+#endif
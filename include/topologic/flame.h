@@ -0,0 +1,723 @@
+/**\file
+ * \brief CPU fractal flame renderer
+ *
+ * The OpenGL renderer can colour models with the fractal flame algorithm,
+ * which accumulates how often every pixel is hit and maps the logarithm of
+ * that density - and an average colour coordinate - to the final colour. This
+ * file implements the same idea on the CPU, so that flame images can be
+ * produced on machines without a GPU.
+ *
+ * Flame colouring is a colouring mode that works with any model, not just
+ * libefgy's random flames, and the OpenGL renderer implements it by drawing
+ * the model's faces into a histogram with additive blending. That is what
+ * this renderer reproduces: it picks random points on the model's faces,
+ * weighted by area, and accumulates them in a histogram, so regions where
+ * many faces overlap are hit more often. It does not run a chaos game of
+ * its own; libefgy's random flame models already are the iterated function
+ * system's attractor, expanded into faces from the seed, the functions and
+ * the flame coefficients, and a separate chaos game would produce a
+ * different image than the OpenGL renderer - and none at all for models
+ * that aren't flames.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ * \see http://flam3.com/flame_draves.pdf for the original paper describing
+ *      the fractal flame algorithm.
+ */
+
+#if !defined(TOPOLOGIC_FLAME_H)
+#define TOPOLOGIC_FLAME_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <topologic/binary.h>
+#include <topologic/sink.h>
+
+namespace topologic {
+namespace render {
+/**\brief CPU fractal flame renderer
+ *
+ * A face sink that collects 2D faces, then samples them with iterate() into a
+ * density histogram, which tonemap() turns into an 8 bit RGBA bitmap.
+ * Sampling is split into a fixed number of streams, each with its own random
+ * number generator, which are shared out between one thread per core. Each
+ * thread accumulates into a histogram of its own, and these are merged in
+ * thread order, but only when the histogram is needed - by tonemap() or
+ * save() - rather than after every call to iterate(). The threads and their
+ * histograms are kept until the renderer is destroyed.
+ *
+ * Both the hit counts and the colour coordinates are accumulated as
+ * integers - the latter in fixed point - so merging is exact. The result
+ * only depends on the seed and the number of streams, not on the number of
+ * cores or on how the streams are scheduled.
+ */
+class flame : public sink {
+public:
+  /**\brief RGBA colour
+   *
+   * Colour components in the range [0, 1].
+   */
+  typedef std::array<float, 4> colour;
+
+  /**\brief Construct with image size, colours and seed
+   *
+   * \param[in] pWidth      Width of the image, in pixels.
+   * \param[in] pHeight     Height of the image, in pixels.
+   * \param[in] pBackground Colour of pixels that are never hit.
+   * \param[in] pPalette    Colour map to look up colour coordinates in. If
+   *                        this is empty, a palette is derived from the seed.
+   * \param[in] pSeed       Seed for the random number generators.
+   * \param[in] pStreams    Number of sampling streams. This does not depend
+   *                        on the number of cores, as it affects the image.
+   */
+  flame(std::size_t pWidth, std::size_t pHeight, const colour &pBackground,
+        const std::vector<colour> &pPalette, unsigned long pSeed,
+        std::size_t pStreams = defaultStreams)
+      : width(pWidth), height(pHeight), samples(0), background(pBackground),
+        palette(pPalette), faceVertices(0), faceCount(0), area(0),
+        generation(0), pending(0), next(0), busy(0), stopping(false) {
+    pStreams = std::max<std::size_t>(1, pStreams);
+    for (std::size_t i = 0; i < pStreams; i++) {
+      std::seed_seq seq{(unsigned long)(pSeed), (unsigned long)(i)};
+      generators.push_back(std::mt19937(seq));
+    }
+
+    if (palette.empty()) {
+      std::mt19937 rng((std::uint32_t(pSeed)));
+      std::uniform_real_distribution<float> u(0, 1);
+      for (std::size_t i = 0; i < 8; i++) {
+        palette.push_back({{u(rng), u(rng), u(rng), 1}});
+      }
+    }
+
+    hits.assign(width * height, 0);
+    colours.assign(width * height, 0);
+
+    std::size_t n = std::thread::hardware_concurrency();
+    local.resize(std::max<std::size_t>(1, std::min(n, pStreams)));
+    for (histogram &h : local) {
+      h.hits.assign(width * height, 0);
+      h.colours.assign(width * height, 0);
+    }
+  }
+
+  /**\brief Copy constructor
+   *
+   * The copy constructor is explicitly deleted, as the sampling threads
+   * refer to the renderer they were started by.
+   */
+  flame(const flame &) = delete;
+
+  /**\brief Destructor
+   *
+   * Stops the sampling threads.
+   */
+  ~flame(void) {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &t : workers) {
+      t.join();
+    }
+  }
+
+  std::size_t dimension(void) const { return 2; }
+
+  bool begin(const std::string &, std::size_t pDimension,
+             std::size_t pFaceVertices) {
+    faceVertices = pFaceVertices;
+    faceCount = 0;
+    triangles.clear();
+    cumulative.clear();
+    area = 0;
+    return pDimension == 2 && width > 0 && height > 0;
+  }
+
+  /**\copydoc sink::faces
+   *
+   * Splits the faces into triangles, in pixel coordinates, and keeps a
+   * running total of their areas so they can be sampled by area later on.
+   * Triangles that can't be seen, or that don't have finite coordinates,
+   * are dropped.
+   */
+  bool faces(const double *coordinates, std::size_t count) {
+    const double sx = double(width) / 2.4, sy = double(height) / 2.4;
+    std::vector<double> v(faceVertices * 2);
+
+    for (std::size_t n = 0; n < count; n++) {
+      for (std::size_t i = 0; i < faceVertices; i++, coordinates += 2) {
+        v[i * 2] = (coordinates[0] + 1.2) * sx;
+        v[i * 2 + 1] = (coordinates[1] + 1.2) * sy;
+      }
+
+      for (std::size_t i = 2; i < faceVertices; i++) {
+        const double *a = &v[0], *b = &v[(i - 1) * 2], *c = &v[i * 2];
+        const double x0 = std::min(a[0], std::min(b[0], c[0]));
+        const double y0 = std::min(a[1], std::min(b[1], c[1]));
+        const double x1 = std::max(a[0], std::max(b[0], c[0]));
+        const double y1 = std::max(a[1], std::max(b[1], c[1]));
+        const double size =
+            std::fabs((b[0] - a[0]) * (c[1] - a[1]) -
+                      (b[1] - a[1]) * (c[0] - a[0])) / 2;
+        if (!std::isfinite(size) || size <= 0 || x1 < 0 || y1 < 0 ||
+            x0 >= double(width) || y0 >= double(height)) {
+          continue;
+        }
+
+        triangle t = {{float(a[0]), float(a[1]), float(b[0] - a[0]),
+                       float(b[1] - a[1]), float(c[0] - a[0]),
+                       float(c[1] - a[1]), float(faceCount + n)}};
+        triangles.push_back(t);
+        area += size;
+        cumulative.push_back(area);
+      }
+    }
+
+    faceCount += count;
+
+    return true;
+  }
+
+  bool end(void) { return true; }
+
+  /**\brief Accumulate samples
+   *
+   * Picks random points on the collected faces and adds them to the
+   * sampling threads' histograms. Can be called repeatedly to refine an
+   * image; every call continues where the previous one left off. The
+   * sampling threads are started by the first call.
+   *
+   * \param[in] count Number of samples to take.
+   *
+   * \returns 'true' upon success.
+   */
+  bool iterate(std::uint64_t count) {
+    if (triangles.empty()) {
+      samples += count;
+      return true;
+    }
+
+    std::unique_lock<std::mutex> lock(mutex);
+    for (std::size_t w = workers.size() + 1; w < local.size(); w++) {
+      workers.push_back(std::thread(&flame::worker, this, w, generation));
+    }
+
+    pending = count;
+    next = 0;
+    busy = workers.size();
+    generation++;
+    lock.unlock();
+    wake.notify_all();
+
+    work(0);
+
+    lock.lock();
+    finished.wait(lock, [this]() { return busy == 0; });
+
+    samples += count;
+
+    return true;
+  }
+
+  /**\brief Save checkpoint
+   *
+   * Writes the histogram, the sample count and the state of the random
+   * number generators, so that rendering can be resumed with load() later
+   * on. The data is little endian:
+   *
+   * | Size | Content                                               |
+   * | ---- | ----------------------------------------------------- |
+   * | 8    | Magic: "TPLGFLM" followed by a 0 byte                  |
+   * | 4    | Format version; currently 2                            |
+   * | 4+n  | Length and bytes of the key                            |
+   * | 12   | Width, height and number of streams                    |
+   * | 8    | Number of samples taken so far                         |
+   * | 4+n  | Length and bytes of each stream's generator state      |
+   * | 8*wh | Hit counts, as uint64                                  |
+   * | 8*wh | Colour coordinate sums, as uint64 with 16 bit fraction |
+   *
+   * \param[out] output The stream to write to.
+   * \param[in]  key    Identifies the model and settings that the
+   *                    histogram belongs to; load() only accepts
+   *                    checkpoints with the same key.
+   *
+   * \returns 'true' if the stream is still good after writing.
+   */
+  bool save(std::ostream &output, const std::string &key) {
+    merge();
+
+    output.write("TPLGFLM", 8);
+    binary::put(output, std::uint32_t(2));
+    putString(output, key);
+    binary::put(output, std::uint32_t(width));
+    binary::put(output, std::uint32_t(height));
+    binary::put(output, std::uint32_t(generators.size()));
+    binary::put(output, std::uint64_t(samples));
+    for (const auto &g : generators) {
+      std::ostringstream state("");
+      state << g;
+      putString(output, state.str());
+    }
+    binary::put(output, hits);
+    binary::put(output, colours);
+
+    return bool(output);
+  }
+
+  /**\brief Load checkpoint
+   *
+   * Restores the histogram, the sample count and the random number
+   * generators from a checkpoint written with save(). The checkpoint is only
+   * used if it was written with the same key, image size and number of
+   * streams; otherwise the renderer is left untouched.
+   *
+   * \param[in] input The stream to read from.
+   * \param[in] key   The key that the checkpoint must have been saved with.
+   *
+   * \returns 'true' if the checkpoint was loaded.
+   */
+  bool load(std::istream &input, const std::string &key) {
+    char magic[8];
+    std::uint32_t version, w, h, n;
+    std::uint64_t count;
+    std::string k;
+
+    if (!input.read(magic, 8) || std::memcmp(magic, "TPLGFLM", 8) != 0 ||
+        !binary::get(input, version) || version != 2 ||
+        !getString(input, k) || k != key || !binary::get(input, w) ||
+        !binary::get(input, h) || !binary::get(input, n) || w != width ||
+        h != height || n != generators.size() ||
+        !binary::get(input, count)) {
+      return false;
+    }
+
+    std::vector<std::mt19937> g(n);
+    for (auto &generator : g) {
+      std::string state;
+      if (!getString(input, state)) {
+        return false;
+      }
+      std::istringstream in(state);
+      if (!(in >> generator)) {
+        return false;
+      }
+    }
+
+    std::vector<std::uint64_t> newHits(width * height),
+        newColours(width * height);
+    if (!binary::get(input, newHits) || !binary::get(input, newColours)) {
+      return false;
+    }
+
+    generators.swap(g);
+    hits.swap(newHits);
+    colours.swap(newColours);
+    samples = count;
+    for (histogram &h : local) {
+      std::fill(h.hits.begin(), h.hits.end(), 0);
+      std::fill(h.colours.begin(), h.colours.end(), 0);
+    }
+
+    return true;
+  }
+
+  /**\brief Map histogram to colours
+   *
+   * Turns the current histogram into an image: the logarithm of each pixel's
+   * hit count, relative to the most frequently hit pixel, determines how
+   * much of the pixel's average palette colour is blended over the
+   * background.
+   */
+  void tonemap(void) {
+    merge();
+    pixels.assign(width * height * 4, 0);
+
+    std::uint64_t peak = 0;
+    for (const std::uint64_t h : hits) {
+      peak = std::max(peak, h);
+    }
+    const double scale = peak > 0 ? 1. / std::log1p(double(peak)) : 0;
+
+    for (std::size_t i = 0; i < width * height; i++) {
+      colour c = background;
+      if (hits[i] > 0) {
+        const float a = float(
+            std::pow(std::log1p(double(hits[i])) * scale, 1. / gamma));
+        const colour p = lookup(
+            float(double(colours[i]) / double(hits[i]) / colourScale));
+        for (std::size_t k = 0; k < 3; k++) {
+          c[k] = c[k] * (1.f - a) + p[k] * a;
+        }
+        c[3] = c[3] * (1.f - a) + a;
+      }
+      for (std::size_t k = 0; k < 4; k++) {
+        pixels[i * 4 + k] =
+            std::uint8_t(std::min(1.f, std::max(0.f, c[k])) * 255.f + .5f);
+      }
+    }
+  }
+
+  /**\brief Image width
+   *
+   * Width of the image, in pixels.
+   */
+  const std::size_t width;
+
+  /**\brief Image height
+   *
+   * Height of the image, in pixels.
+   */
+  const std::size_t height;
+
+  /**\brief Sample count
+   *
+   * Number of samples that have been taken so far.
+   */
+  std::uint64_t samples;
+
+  /**\brief Pixels
+   *
+   * RGBA values of the image's pixels, row by row, starting at the top left
+   * corner. Filled in by tonemap().
+   */
+  std::vector<std::uint8_t> pixels;
+
+protected:
+  /**\brief Sampled triangle
+   *
+   * The first vertex, the two edges from it to the other vertices, and the
+   * index of the face the triangle belongs to.
+   */
+  typedef std::array<float, 7> triangle;
+
+  /**\brief Density histogram
+   *
+   * Hit counts and colour coordinate sums for each pixel. Colour
+   * coordinates are fixed point numbers, in units of 1/colourScale.
+   */
+  class histogram {
+  public:
+    /**\brief Hit counts
+     *
+     * How often each pixel has been hit.
+     */
+    std::vector<std::uint64_t> hits;
+
+    /**\brief Colour coordinate sums
+     *
+     * Sum of the colour coordinates of all the samples that hit a pixel.
+     */
+    std::vector<std::uint64_t> colours;
+  };
+
+  /**\brief Gamma
+   *
+   * Applied to the log density; values above 1 bring out sparse regions.
+   */
+  static constexpr double gamma = 2.2;
+
+  /**\brief Default number of streams
+   *
+   * Enough to keep the cores of most machines busy.
+   */
+  static const std::size_t defaultStreams = 16;
+
+  /**\brief Colour coordinate scale
+   *
+   * Colour coordinates are accumulated as fixed point numbers with this
+   * many steps between 0 and 1.
+   */
+  static const std::uint64_t colourScale = 1 << 16;
+
+  /**\brief Write length-prefixed string
+   *
+   * \param[out] output The stream to write to.
+   * \param[in]  value  The string to write.
+   */
+  static void putString(std::ostream &output, const std::string &value) {
+    binary::put(output, std::uint32_t(value.size()));
+    output.write(value.data(), value.size());
+  }
+
+  /**\brief Read length-prefixed string
+   *
+   * \param[in]  input The stream to read from.
+   * \param[out] value The string that was read.
+   *
+   * \returns 'true' if a complete string was read.
+   */
+  static bool getString(std::istream &input, std::string &value) {
+    std::uint32_t length;
+    if (!binary::get(input, length) || length > (1u << 24)) {
+      return false;
+    }
+    value.assign(length, 0);
+    return length == 0 || bool(input.read(&value[0], length));
+  }
+
+  /**\brief Sampling thread
+   *
+   * Waits for iterate() to hand out work, then takes its share of the
+   * samples, until the renderer is destroyed.
+   *
+   * \param[in] w    Index of the thread's histogram.
+   * \param[in] seen The last round of work that was handed out before the
+   *                 thread was started.
+   */
+  void worker(std::size_t w, std::uint64_t seen) {
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock,
+                  [this, seen]() { return stopping || generation != seen; });
+        if (stopping) {
+          return;
+        }
+        seen = generation;
+      }
+
+      work(w);
+
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--busy == 0) {
+        finished.notify_all();
+      }
+    }
+  }
+
+  /**\brief Take share of samples
+   *
+   * Runs streams that no other thread has picked up yet in the current
+   * round of work, until there are none left.
+   *
+   * \param[in] w Index of the histogram to accumulate into.
+   */
+  void work(std::size_t w) {
+    const std::size_t streams = generators.size();
+    for (std::size_t s = next++; s < streams; s = next++) {
+      stream(generators[s], pending / streams + (s < pending % streams),
+             local[w]);
+    }
+  }
+
+  /**\brief Merge histograms
+   *
+   * Adds the sampling threads' histograms to the shared one, in thread
+   * order, and clears them.
+   */
+  void merge(void) {
+    for (histogram &h : local) {
+      for (std::size_t p = 0; p < width * height; p++) {
+        hits[p] += h.hits[p];
+        colours[p] += h.colours[p];
+        h.hits[p] = 0;
+        h.colours[p] = 0;
+      }
+    }
+  }
+
+  /**\brief Run sampling stream
+   *
+   * Takes samples with one random number generator, accumulating them in the
+   * given histogram.
+   *
+   * \param[in,out] rng   The stream's random number generator.
+   * \param[in]     count Number of samples to take.
+   * \param[in,out] h     The histogram to add the samples to.
+   */
+  void stream(std::mt19937 &rng, std::uint64_t count, histogram &h) const {
+    std::uniform_real_distribution<double> pick(0, area);
+    std::uniform_real_distribution<float> u(0, 1);
+    const double unit =
+        double(colourScale) / double(std::max<std::size_t>(faceCount, 2) - 1);
+
+    for (std::uint64_t i = 0; i < count; i++) {
+      const std::size_t k = std::min<std::size_t>(
+          std::upper_bound(cumulative.begin(), cumulative.end(), pick(rng)) -
+              cumulative.begin(),
+          triangles.size() - 1);
+      const triangle &t = triangles[k];
+      float r1 = u(rng), r2 = u(rng);
+      if (r1 + r2 > 1.f) {
+        r1 = 1.f - r1;
+        r2 = 1.f - r2;
+      }
+      const float x = t[0] + r1 * t[2] + r2 * t[4];
+      const float y = t[1] + r1 * t[3] + r2 * t[5];
+      if (x >= 0 && y >= 0 && x < float(width) && y < float(height)) {
+        const std::size_t p = std::size_t(y) * width + std::size_t(x);
+        h.hits[p]++;
+        h.colours[p] += std::uint64_t(double(t[6]) * unit + .5);
+      }
+    }
+  }
+
+  /**\brief Look up palette colour
+   *
+   * Interpolates linearly between the palette's entries.
+   *
+   * \param[in] t Colour coordinate in the range [0, 1].
+   *
+   * \returns The colour at the given coordinate.
+   */
+  colour lookup(float t) const {
+    const float f = std::min(1.f, std::max(0.f, t)) * (palette.size() - 1);
+    const std::size_t i = std::min(std::size_t(f), palette.size() - 1);
+    const std::size_t j = std::min(i + 1, palette.size() - 1);
+    const float w = f - float(i);
+    colour c;
+    for (std::size_t k = 0; k < 4; k++) {
+      c[k] = palette[i][k] * (1.f - w) + palette[j][k] * w;
+    }
+    return c;
+  }
+
+  /**\brief Background colour
+   *
+   * The colour of pixels that are never hit.
+   */
+  const colour background;
+
+  /**\brief Colour map
+   *
+   * The colours that colour coordinates are mapped to.
+   */
+  std::vector<colour> palette;
+
+  /**\brief Random number generators
+   *
+   * One for each sampling stream.
+   */
+  std::vector<std::mt19937> generators;
+
+  /**\brief Hit counts
+   *
+   * How often each pixel has been hit.
+   */
+  std::vector<std::uint64_t> hits;
+
+  /**\brief Colour coordinate sums
+   *
+   * Sum of the colour coordinates of all the samples that hit a pixel, in
+   * units of 1/colourScale.
+   */
+  std::vector<std::uint64_t> colours;
+
+  /**\brief Vertices per face
+   *
+   * Set by begin().
+   */
+  std::size_t faceVertices;
+
+  /**\brief Face count
+   *
+   * Number of faces passed to faces() so far; used to derive each face's
+   * colour coordinate from its position in the model.
+   */
+  std::size_t faceCount;
+
+  /**\brief Collected triangles
+   *
+   * The visible triangles of all the faces passed to faces().
+   */
+  std::vector<triangle> triangles;
+
+  /**\brief Cumulative triangle areas
+   *
+   * Running total of the triangles' areas, for sampling them by area.
+   */
+  std::vector<double> cumulative;
+
+  /**\brief Total area
+   *
+   * Sum of the areas of all the collected triangles, in square pixels.
+   */
+  double area;
+
+  /**\brief Sampling threads' histograms
+   *
+   * One for each sampling thread, including the one that calls iterate(),
+   * which uses the first one.
+   */
+  std::vector<histogram> local;
+
+  /**\brief Sampling threads
+   *
+   * Started by the first call to iterate(); the thread that calls iterate()
+   * takes part in sampling, so there is one fewer of these than there are
+   * histograms.
+   */
+  std::vector<std::thread> workers;
+
+  /**\brief Work lock
+   *
+   * Guards the members used to hand out work to the sampling threads.
+   */
+  std::mutex mutex;
+
+  /**\brief Work available
+   *
+   * Signalled when iterate() hands out a new round of work, or when the
+   * renderer is destroyed.
+   */
+  std::condition_variable wake;
+
+  /**\brief Work finished
+   *
+   * Signalled when the last sampling thread has finished its share.
+   */
+  std::condition_variable finished;
+
+  /**\brief Round of work
+   *
+   * Incremented whenever iterate() hands out work.
+   */
+  std::uint64_t generation;
+
+  /**\brief Samples in current round
+   *
+   * The number of samples that the current round of work consists of.
+   */
+  std::uint64_t pending;
+
+  /**\brief Next stream
+   *
+   * The next stream that no thread has picked up yet in the current round.
+   */
+  std::atomic<std::size_t> next;
+
+  /**\brief Busy threads
+   *
+   * The number of sampling threads that haven't finished the current round.
+   */
+  std::size_t busy;
+
+  /**\brief Stop threads?
+   *
+   * Set by the destructor to make the sampling threads exit.
+   */
+  bool stopping;
+};
+}
+}
+
+#endif
@@ -0,0 +1,167 @@
+/**\file
+ * \brief Streaming JSON geometry
+ *
+ * The JSON output normally only contains the state metadata. Clients such as
+ * the WebGL frontend may also want the geometry itself, and since models can
+ * get rather large, this geometry is written directly to the output stream
+ * instead of being collected in a JSON value tree first.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_GEOMETRY_H)
+#define TOPOLOGIC_GEOMETRY_H
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+
+#include <topologic/sink.h>
+
+namespace topologic {
+namespace render {
+/**\brief Streaming JSON geometry writer
+ *
+ * Writes a JSON object member of the form
+ *
+ *     "geometry":{"dimension":D,"faceVertices":F,"projected":P,
+ *                 "faces":[x0,y0,z0,x1,y1,z1,...]}
+ *
+ * to an output stream, one chunk of faces at a time. The coordinates of all
+ * the faces are written as a single flat array, so that clients can turn them
+ * into a typed array directly; "dimension" and "faceVertices" give the stride.
+ */
+class geometry : public sink {
+public:
+  /**\brief Construct with output stream and settings
+   *
+   * \param[out] pOutput    The stream to write to.
+   * \param[in]  pProjected Whether to ask for faces projected to 3D, or for
+   *                        faces in the model's render depth.
+   * \param[in]  pPrecision Number of significant digits to write.
+   */
+  geometry(std::ostream &pOutput, bool pProjected, std::streamsize pPrecision)
+      : output(pOutput), projected(pProjected), precision(pPrecision),
+        oldPrecision(0), first(true), open(false) {}
+
+  /**\brief Destructor
+   *
+   * Closes the face array and the geometry object, if that hasn't happened
+   * yet.
+   */
+  ~geometry(void) { end(); }
+
+  std::size_t dimension(void) const { return projected ? 3 : 0; }
+
+  /**\copydoc sink::begin
+   *
+   * Writes everything up to and including the opening bracket of the face
+   * array.
+   */
+  bool begin(const std::string &, std::size_t pDimension,
+             std::size_t faceVertices) {
+    oldPrecision = output.precision(precision);
+    output << "\"geometry\":{\"dimension\":" << pDimension
+           << ",\"faceVertices\":" << faceVertices
+           << ",\"projected\":" << (projected ? "true" : "false")
+           << ",\"faces\":[";
+    coordinates = pDimension * faceVertices;
+    first = true;
+    open = true;
+
+    return bool(output);
+  }
+
+  /**\copydoc sink::faces
+   *
+   * Appends the coordinates of the faces to the face array. Faces with
+   * coordinates that aren't finite, e.g. because a vertex was projected from
+   * right next to the camera, are skipped, as JSON can't represent them.
+   */
+  bool faces(const double *pCoordinates, std::size_t count) {
+    for (std::size_t n = 0; n < count; n++, pCoordinates += coordinates) {
+      if (!std::all_of(pCoordinates, pCoordinates + coordinates,
+                       [](double c) { return std::isfinite(c); })) {
+        continue;
+      }
+      for (std::size_t i = 0; i < coordinates; i++) {
+        if (!first) {
+          output << ",";
+        }
+        first = false;
+        output << pCoordinates[i];
+      }
+    }
+
+    return bool(output);
+  }
+
+  /**\copydoc sink::end
+   *
+   * Closes the face array and the geometry object and restores the output
+   * stream's precision.
+   */
+  bool end(void) {
+    if (open) {
+      output << "]}";
+      output.precision(oldPrecision);
+      open = false;
+    }
+
+    return bool(output);
+  }
+
+protected:
+  /**\brief Output stream
+   *
+   * The stream that the geometry is written to.
+   */
+  std::ostream &output;
+
+  /**\brief Project to 3D?
+   *
+   * Whether the faces are requested in 3D or in the model's render depth.
+   */
+  const bool projected;
+
+  /**\brief Output precision
+   *
+   * Number of significant digits to write coordinates with.
+   */
+  const std::streamsize precision;
+
+  /**\brief Previous stream precision
+   *
+   * The precision of the output stream before this writer changed it.
+   */
+  std::streamsize oldPrecision;
+
+  /**\brief Coordinates per face
+   *
+   * Set by begin().
+   */
+  std::size_t coordinates;
+
+  /**\brief Expecting first coordinate?
+   *
+   * Used to place commas between coordinates.
+   */
+  bool first;
+
+  /**\brief Is the geometry object open?
+   *
+   * Set by begin() and cleared by end(), so that the closing brackets are
+   * only written once.
+   */
+  bool open;
+};
+}
+}
+
+#endif
@@ -0,0 +1,293 @@
+/**\file
+ * \brief Bitmap image output
+ *
+ * Writers for the bitmap formats produced by the software rasteriser: binary
+ * PPM, for pipelines that feed images to other tools, raw RGBA, for video
+ * encoders, and PNG, for everything else.
+ *
+ * The PNG writer does not compress the image; it uses stored deflate blocks,
+ * which every PNG decoder supports, so that Topologic doesn't have to depend
+ * on zlib just to produce thumbnails. Pipe the output through a PNG optimiser
+ * if size matters.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ * \see PNG Specification: https://www.w3.org/TR/PNG/
+ */
+
+#if !defined(TOPOLOGIC_IMAGE_H)
+#define TOPOLOGIC_IMAGE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <ostream>
+#include <vector>
+
+namespace topologic {
+/**\brief Bitmap image output
+ *
+ * Contains functions to write 8 bit RGBA images to output streams.
+ */
+namespace image {
+/**\brief Bitmap format
+ *
+ * Selects one of the formats that write() can produce.
+ */
+enum format {
+  /**\brief PNG image
+   *
+   * See png().
+   */
+  formatPNG = 0,
+
+  /**\brief Binary PPM image
+   *
+   * See ppm().
+   */
+  formatPPM = 1,
+
+  /**\brief Raw RGBA pixels
+   *
+   * See rgba().
+   */
+  formatRGBA = 2
+};
+
+/**\brief CRC-32 checksum
+ *
+ * The checksum used by PNG chunks, as described in the PNG specification.
+ *
+ * \param[in] data   The data to checksum.
+ * \param[in] length Number of bytes in the data.
+ * \param[in] crc    Checksum of any preceding data, to continue from.
+ *
+ * \returns The updated checksum.
+ */
+static inline std::uint32_t crc32(const std::uint8_t *data, std::size_t length,
+                                  std::uint32_t crc = 0) {
+  static const struct table {
+    table(void) {
+      for (std::uint32_t n = 0; n < 256; n++) {
+        std::uint32_t c = n;
+        for (std::size_t k = 0; k < 8; k++) {
+          c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+        }
+        value[n] = c;
+      }
+    }
+    std::uint32_t value[256];
+  } t;
+
+  crc = ~crc;
+  for (std::size_t i = 0; i < length; i++) {
+    crc = t.value[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+/**\brief Write big endian value
+ *
+ * PNG stores all of its integers in network byte order.
+ *
+ * \param[out] output The buffer to append to.
+ * \param[in]  value  The value to append.
+ */
+static inline void putBE(std::vector<std::uint8_t> &output,
+                         std::uint32_t value) {
+  output.push_back(std::uint8_t(value >> 24));
+  output.push_back(std::uint8_t(value >> 16));
+  output.push_back(std::uint8_t(value >> 8));
+  output.push_back(std::uint8_t(value));
+}
+
+/**\brief Write PNG chunk
+ *
+ * Writes a single PNG chunk, with its length and checksum.
+ *
+ * \param[out] output The stream to write to.
+ * \param[in]  type   The four letter chunk type, e.g. "IHDR".
+ * \param[in]  data   The chunk's payload.
+ */
+static inline void chunk(std::ostream &output, const char type[5],
+                         const std::vector<std::uint8_t> &data) {
+  std::vector<std::uint8_t> header;
+  putBE(header, std::uint32_t(data.size()));
+  header.insert(header.end(), type, type + 4);
+
+  std::vector<std::uint8_t> trailer;
+  putBE(trailer, crc32(data.data(), data.size(),
+                       crc32(header.data() + 4, 4)));
+
+  output.write((const char *)header.data(), header.size());
+  output.write((const char *)data.data(), data.size());
+  output.write((const char *)trailer.data(), trailer.size());
+}
+
+/**\brief Write PNG image
+ *
+ * Writes an 8 bit RGBA image as a PNG file.
+ *
+ * \param[out] output The stream to write to.
+ * \param[in]  width  Width of the image, in pixels.
+ * \param[in]  height Height of the image, in pixels.
+ * \param[in]  pixels RGBA values of the image's pixels, row by row, starting
+ *                    at the top left corner.
+ *
+ * \returns 'true' if the stream is still good after writing the image.
+ */
+static inline bool png(std::ostream &output, std::size_t width,
+                       std::size_t height,
+                       const std::vector<std::uint8_t> &pixels) {
+  const std::size_t stride = width * 4;
+  if (pixels.size() < stride * height) {
+    return false;
+  }
+
+  output.write("\x89PNG\r\n\x1a\n", 8);
+
+  std::vector<std::uint8_t> data;
+  putBE(data, std::uint32_t(width));
+  putBE(data, std::uint32_t(height));
+  data.push_back(8); // bit depth
+  data.push_back(6); // colour type: RGBA
+  data.push_back(0); // compression method
+  data.push_back(0); // filter method
+  data.push_back(0); // interlace method
+  chunk(output, "IHDR", data);
+
+  // zlib stream with stored deflate blocks; each scanline is prefixed with
+  // filter type 0, and the blocks are at most 65535 bytes long.
+  const std::size_t raw = (stride + 1) * height;
+  data.clear();
+  data.reserve(2 + raw + (raw / 65535 + 1) * 5 + 4);
+  data.push_back(0x78);
+  data.push_back(0x01);
+
+  std::uint32_t a = 1, b = 0;
+  std::size_t block = 0, blockStart = 0;
+  for (std::size_t i = 0; i < raw; i++) {
+    if (block == 0) {
+      block = std::min<std::size_t>(raw - i, 65535);
+      data.push_back(i + block == raw ? 1 : 0);
+      data.push_back(std::uint8_t(block));
+      data.push_back(std::uint8_t(block >> 8));
+      data.push_back(std::uint8_t(~block));
+      data.push_back(std::uint8_t(~block >> 8));
+      blockStart = i;
+    }
+
+    const std::size_t row = i / (stride + 1), column = i % (stride + 1);
+    const std::uint8_t byte =
+        column == 0 ? 0 : pixels[row * stride + column - 1];
+    data.push_back(byte);
+    a = (a + byte) % 65521;
+    b = (b + a) % 65521;
+
+    if (i + 1 - blockStart == block) {
+      block = 0;
+    }
+  }
+  putBE(data, (b << 16) | a);
+  chunk(output, "IDAT", data);
+
+  data.clear();
+  chunk(output, "IEND", data);
+
+  return bool(output);
+}
+
+/**\brief Write PPM image
+ *
+ * Writes an 8 bit RGBA image as a binary PPM file. PPM doesn't support
+ * transparency, so the alpha channel is dropped.
+ *
+ * \param[out] output The stream to write to.
+ * \param[in]  width  Width of the image, in pixels.
+ * \param[in]  height Height of the image, in pixels.
+ * \param[in]  pixels RGBA values of the image's pixels, row by row, starting
+ *                    at the top left corner.
+ *
+ * \returns 'true' if the stream is still good after writing the image.
+ */
+static inline bool ppm(std::ostream &output, std::size_t width,
+                       std::size_t height,
+                       const std::vector<std::uint8_t> &pixels) {
+  if (pixels.size() < width * height * 4) {
+    return false;
+  }
+
+  output << "P6\n" << width << " " << height << "\n255\n";
+
+  std::vector<std::uint8_t> row(width * 3);
+  for (std::size_t y = 0; y < height; y++) {
+    for (std::size_t x = 0; x < width; x++) {
+      const std::uint8_t *p = &pixels[(y * width + x) * 4];
+      row[x * 3] = p[0];
+      row[x * 3 + 1] = p[1];
+      row[x * 3 + 2] = p[2];
+    }
+    output.write((const char *)row.data(), row.size());
+  }
+
+  return bool(output);
+}
+
+/**\brief Write raw RGBA pixels
+ *
+ * Writes the pixels of an 8 bit RGBA image without any header, which is what
+ * video encoders expect as 'rawvideo' input. Consecutive images can be
+ * written back to back to form a video stream.
+ *
+ * \param[out] output The stream to write to.
+ * \param[in]  width  Width of the image, in pixels.
+ * \param[in]  height Height of the image, in pixels.
+ * \param[in]  pixels RGBA values of the image's pixels, row by row, starting
+ *                    at the top left corner.
+ *
+ * \returns 'true' if the stream is still good after writing the image.
+ */
+static inline bool rgba(std::ostream &output, std::size_t width,
+                        std::size_t height,
+                        const std::vector<std::uint8_t> &pixels) {
+  if (pixels.size() < width * height * 4) {
+    return false;
+  }
+
+  return bool(output.write((const char *)pixels.data(), width * height * 4));
+}
+
+/**\brief Write image
+ *
+ * Writes an 8 bit RGBA image in the given format.
+ *
+ * \param[out] output The stream to write to.
+ * \param[in]  type   The format to write the image in.
+ * \param[in]  width  Width of the image, in pixels.
+ * \param[in]  height Height of the image, in pixels.
+ * \param[in]  pixels RGBA values of the image's pixels, row by row, starting
+ *                    at the top left corner.
+ *
+ * \returns 'true' if the stream is still good after writing the image.
+ */
+static inline bool write(std::ostream &output, enum format type,
+                         std::size_t width, std::size_t height,
+                         const std::vector<std::uint8_t> &pixels) {
+  switch (type) {
+  case formatPPM:
+    return ppm(output, width, height, pixels);
+  case formatRGBA:
+    return rgba(output, width, height, pixels);
+  case formatPNG:
+  default:
+    return png(output, width, height, pixels);
+  }
+}
+}
+}
+
+#endif
@@ -0,0 +1,130 @@
+/**\file
+ * \brief Input files
+ *
+ * Provides read-only access to the contents of the files passed in on the
+ * command line. Regular files are mapped into memory rather than copied, so
+ * parsers that only need to look at the start of a file - like the XML
+ * metadata reader - never cause the rest of it to be read from disk, and
+ * large files don't need to fit in memory twice.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_INPUT_H)
+#define TOPOLOGIC_INPUT_H
+
+#include <cerrno>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace topologic {
+/**\brief Input file contents
+ *
+ * Makes the contents of a file available as a contiguous, read-only block
+ * of memory. Regular files are mapped with mmap(); anything that can't be
+ * mapped, such as pipes or terminals, is read into a buffer instead.
+ *
+ * Files that can't be opened at all appear to be empty.
+ */
+class input {
+public:
+  /**\brief Open file
+   *
+   * Maps or reads the contents of the given file.
+   *
+   * \param[in] filename The name of the file to open.
+   */
+  input(const std::string &filename) : mapped(0), length(0) {
+    const int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+
+    struct stat st;
+    if ((fstat(fd, &st) == 0) && S_ISREG(st.st_mode) && (st.st_size > 0)) {
+      void *m = mmap(0, std::size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+      if (m != MAP_FAILED) {
+        mapped = m;
+        length = std::size_t(st.st_size);
+        close(fd);
+        return;
+      }
+    }
+
+    char chunk[65536];
+    for (;;) {
+      const ssize_t n = read(fd, chunk, sizeof(chunk));
+      if (n > 0) {
+        buffer.insert(buffer.end(), chunk, chunk + n);
+      } else if ((n == 0) || (errno != EINTR)) {
+        break;
+      }
+    }
+    close(fd);
+  }
+
+  /**\brief Copy constructor
+   *
+   * The copy constructor is explicitly deleted for memory management
+   * reasons.
+   */
+  input(const input &) = delete;
+
+  /**\brief Destructor
+   *
+   * Unmaps the file, if it was mapped.
+   */
+  ~input(void) {
+    if (mapped) {
+      munmap(mapped, length);
+    }
+  }
+
+  /**\brief File contents
+   *
+   * \returns A pointer to the first byte of the file. The contents are not
+   *          terminated with a null byte.
+   */
+  const char *data(void) const {
+    return mapped ? (const char *)mapped : buffer.data();
+  }
+
+  /**\brief File size
+   *
+   * \returns The number of bytes in the file.
+   */
+  std::size_t size(void) const { return mapped ? length : buffer.size(); }
+
+protected:
+  /**\brief Mapped file
+   *
+   * Start of the memory mapping of the file, or 0 if it wasn't mapped.
+   */
+  void *mapped;
+
+  /**\brief Length of mapping
+   *
+   * The number of bytes that were mapped.
+   */
+  std::size_t length;
+
+  /**\brief Read buffer
+   *
+   * Holds the contents of files that couldn't be mapped.
+   */
+  std::vector<char> buffer;
+};
+}
+
+#endif
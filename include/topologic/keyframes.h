@@ -0,0 +1,152 @@
+/**\file
+ * \brief SVG keyframes
+ *
+ * Collects the 2D faces of a model over several frames of an animation, so
+ * they can be written as a single SVG where each face's path is animated with
+ * SMIL, rather than as one SVG per frame. The topology of a model doesn't
+ * change from frame to frame - only the positions of its vertices do - so
+ * every face only needs to be written once, with the list of shapes it goes
+ * through.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ * \see SMIL Animation: https://www.w3.org/TR/SVG11/animate.html
+ */
+
+#if !defined(TOPOLOGIC_KEYFRAMES_H)
+#define TOPOLOGIC_KEYFRAMES_H
+
+#include <limits>
+#include <ostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <topologic/sink.h>
+
+namespace topologic {
+namespace render {
+/**\brief SVG keyframe collector
+ *
+ * A face sink that is meant to be passed the same model once per frame of an
+ * animation. Each frame has to contain the same number of faces, in the same
+ * order, which is the case for all of Topologic's models as long as only the
+ * camera moves.
+ */
+class keyframes : public sink {
+public:
+  keyframes(void) : faceVertices(0), frames(0), current(0) {}
+
+  std::size_t dimension(void) const { return 2; }
+
+  /**\copydoc sink::begin
+   *
+   * Starts a new frame.
+   */
+  bool begin(const std::string &, std::size_t dimension,
+             std::size_t pFaceVertices) {
+    if (frames > 0 && pFaceVertices != faceVertices) {
+      return false;
+    }
+    faceVertices = pFaceVertices;
+    frames++;
+    current = 0;
+    return dimension == 2;
+  }
+
+  /**\copydoc sink::faces
+   *
+   * Converts the faces to SVG path data and appends it to the faces' lists
+   * of shapes. Paths only use absolute coordinates and have the same
+   * commands in every frame, so SVG viewers can interpolate between frames.
+   * Coordinates are written with enough digits to read them back exactly.
+   */
+  bool faces(const double *coordinates, std::size_t count) {
+    std::ostringstream s("");
+    s.precision(std::numeric_limits<double>::max_digits10);
+    for (std::size_t i = 0; i < count; i++, current++) {
+      s.str("");
+      for (std::size_t j = 0; j < faceVertices; j++) {
+        const double *v = coordinates + (i * faceVertices + j) * 2;
+        s << (j == 0 ? "M" : "L") << v[0] << "," << v[1];
+      }
+      s << "Z";
+
+      if (frames == 1) {
+        paths.push_back(s.str());
+      } else if (current < paths.size()) {
+        paths[current] += ";" + s.str();
+      } else {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  /**\copydoc sink::end
+   *
+   * Fails if the frame had a different number of faces than the first one.
+   */
+  bool end(void) { return current == paths.size(); }
+
+  /**\brief Write animated paths
+   *
+   * Writes an SVG path element for each of the faces, starting out with the
+   * face's shape in the first frame. If there was more than one frame, the
+   * path is animated to go through all of its shapes and then start over.
+   *
+   * \param[out] output   The stream to write to.
+   * \param[in]  duration Length of one run through all of the frames, in
+   *                      seconds.
+   *
+   * \returns 'true' if the stream is still good after writing the paths.
+   */
+  bool write(std::ostream &output, double duration) const {
+    for (const auto &p : paths) {
+      if (frames < 2) {
+        output << "<path d='" << p << "'/>";
+      } else {
+        output << "<path d='" << p.substr(0, p.find(';')) << "'>"
+               << "<animate attributeName='d' dur='" << duration
+               << "s' repeatCount='indefinite' values='" << p << "'/>"
+               << "</path>";
+      }
+    }
+    return bool(output);
+  }
+
+protected:
+  /**\brief Vertices per face
+   *
+   * Set by begin().
+   */
+  std::size_t faceVertices;
+
+  /**\brief Frame count
+   *
+   * Number of frames that were started with begin().
+   */
+  std::size_t frames;
+
+  /**\brief Current face
+   *
+   * Index of the next face of the current frame.
+   */
+  std::size_t current;
+
+  /**\brief Path data
+   *
+   * The shapes of each face, one path per frame, separated by semicolons as
+   * in the 'values' attribute of an SMIL animation.
+   */
+  std::vector<std::string> paths;
+};
+}
+}
+
+#endif
@@ -0,0 +1,259 @@
+/**\file
+ * \brief Indexed triangle meshes
+ *
+ * Web viewers and other GPU-based clients want geometry as packed vertex and
+ * index buffers, not as text. This file provides a simple indexed triangle
+ * mesh that can be filled with projected model faces and then be written out
+ * as a binary glTF (GLB) file.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ * \see glTF 2.0 Specification: https://www.khronos.org/registry/glTF/
+ */
+
+#if !defined(TOPOLOGIC_MESH_H)
+#define TOPOLOGIC_MESH_H
+
+#include <array>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <topologic/binary.h>
+#include <topologic/sink.h>
+#include <topologic/version.h>
+
+namespace topologic {
+namespace render {
+/**\brief Indexed triangle mesh
+ *
+ * Collects 3D faces as a deduplicated float32 vertex buffer and a uint32
+ * index buffer. Faces with more than three vertices are split into triangle
+ * fans, so the mesh can be uploaded to a GPU as-is.
+ */
+class mesh : public sink {
+public:
+  mesh(void) : faceVertices(0) {}
+
+  std::size_t dimension(void) const { return 3; }
+
+  /**\copydoc sink::begin
+   *
+   * Faces with fewer than three vertices are silently dropped, since they
+   * don't cover any area.
+   */
+  bool begin(const std::string &, std::size_t, std::size_t pFaceVertices) {
+    faceVertices = pFaceVertices;
+    return true;
+  }
+
+  /**\copydoc sink::faces
+   *
+   * Adds the faces to the mesh; vertices that have been seen before are
+   * reused instead of being added again. Faces with coordinates that aren't
+   * finite as a float, e.g. because a vertex was projected from right next
+   * to the camera, are dropped, as glTF can't represent them.
+   */
+  bool faces(const double *coordinates, std::size_t count) {
+    if (faceVertices < 3) {
+      return true;
+    }
+
+    std::vector<float> v(faceVertices * 3);
+    std::vector<std::uint32_t> index(faceVertices);
+    for (std::size_t n = 0; n < count; n++, coordinates += v.size()) {
+      bool finite = true;
+      for (std::size_t i = 0; i < v.size(); i++) {
+        v[i] = float(coordinates[i]);
+        finite = finite && std::isfinite(v[i]);
+      }
+      if (!finite) {
+        continue;
+      }
+
+      for (std::size_t i = 0; i < faceVertices; i++) {
+        index[i] = vertex(v[i * 3], v[i * 3 + 1], v[i * 3 + 2]);
+      }
+
+      for (std::size_t i = 2; i < faceVertices; i++) {
+        indices.push_back(index[0]);
+        indices.push_back(index[i - 1]);
+        indices.push_back(index[i]);
+      }
+    }
+
+    return true;
+  }
+
+  bool end(void) { return true; }
+
+  /**\brief Write binary glTF
+   *
+   * Writes the mesh as a single binary glTF 2.0 file, with the vertex
+   * positions and triangle indices packed into one binary buffer.
+   *
+   * \param[out] output The stream to write to.
+   * \param[in]  name   Name to give the mesh, e.g. "4-cube".
+   * \param[in]  extras A JSON value to embed as the file's 'extras'; this is
+   *                    typically the serialised Topologic state.
+   *
+   * \returns 'true' if the stream is still good after writing the file.
+   */
+  bool glb(std::ostream &output, const std::string &name,
+           const std::string &extras) const {
+    const std::size_t positionBytes = positions.size() * sizeof(float);
+    const std::size_t indexBytes = indices.size() * sizeof(std::uint32_t);
+    const std::size_t binBytes = positionBytes + indexBytes;
+
+    std::ostringstream json("");
+    json.precision(std::numeric_limits<float>::max_digits10);
+    json << "{\"asset\":{\"version\":\"2.0\",\"generator\":\"Topologic/V"
+         << version << "\"}";
+    if (indices.size() > 0) {
+      json << ",\"scene\":0,\"scenes\":[{\"nodes\":[0]}],"
+              "\"nodes\":[{\"mesh\":0}],"
+              "\"meshes\":[{\"name\":\"" << name
+           << "\",\"primitives\":[{\"attributes\":{\"POSITION\":0},"
+              "\"indices\":1,\"mode\":4}]}],"
+              "\"buffers\":[{\"byteLength\":" << binBytes << "}],"
+              "\"bufferViews\":["
+              "{\"buffer\":0,\"byteOffset\":0,\"byteLength\":" << positionBytes
+           << ",\"target\":34962},"
+              "{\"buffer\":0,\"byteOffset\":" << positionBytes
+           << ",\"byteLength\":" << indexBytes << ",\"target\":34963}],"
+              "\"accessors\":["
+              "{\"bufferView\":0,\"componentType\":5126,\"count\":"
+           << (positions.size() / 3) << ",\"type\":\"VEC3\",\"min\":["
+           << min[0] << "," << min[1] << "," << min[2] << "],\"max\":["
+           << max[0] << "," << max[1] << "," << max[2] << "]},"
+              "{\"bufferView\":1,\"componentType\":5125,\"count\":"
+           << indices.size() << ",\"type\":\"SCALAR\"}]";
+    }
+    json << ",\"extras\":" << extras << "}";
+
+    const std::string header = json.str();
+    const std::size_t jsonBytes = binary::padded(header.size(), 4);
+    const std::size_t total =
+        12 + 8 + jsonBytes + (binBytes > 0 ? 8 + binBytes : 0);
+
+    binary::put(output, std::uint32_t(0x46546C67)); // "glTF"
+    binary::put(output, std::uint32_t(2));
+    binary::put(output, std::uint32_t(total));
+
+    binary::put(output, std::uint32_t(jsonBytes));
+    binary::put(output, std::uint32_t(0x4E4F534A)); // "JSON"
+    output << header;
+    binary::pad(output, header.size(), 4, ' ');
+
+    if (binBytes > 0) {
+      binary::put(output, std::uint32_t(binBytes));
+      binary::put(output, std::uint32_t(0x004E4942)); // "BIN\0"
+      binary::put(output, positions);
+      binary::put(output, indices);
+    }
+
+    return bool(output);
+  }
+
+  /**\brief Vertex positions
+   *
+   * Packed x, y and z coordinates of all the vertices in the mesh.
+   */
+  std::vector<float> positions;
+
+  /**\brief Triangle indices
+   *
+   * Three indices into the vertex buffer for every triangle in the mesh.
+   */
+  std::vector<std::uint32_t> indices;
+
+protected:
+  /**\brief Vertex key
+   *
+   * The bit patterns of a vertex's coordinates, used to find vertices that
+   * have already been added to the mesh.
+   */
+  typedef std::array<std::uint32_t, 3> key;
+
+  /**\brief Vertex key hash
+   *
+   * Combines the bit patterns of a vertex's coordinates into a hash value.
+   */
+  class hash {
+  public:
+    std::size_t operator()(const key &k) const {
+      return std::size_t(k[0]) * 73856093u ^ std::size_t(k[1]) * 19349663u ^
+             std::size_t(k[2]) * 83492791u;
+    }
+  };
+
+  /**\brief Look up or add vertex
+   *
+   * Finds the index of the given vertex, adding it to the vertex buffer and
+   * updating the bounding box if it hasn't been seen before.
+   *
+   * \returns The vertex's index.
+   */
+  std::uint32_t vertex(float x, float y, float z) {
+    key k;
+    std::memcpy(&k[0], &x, sizeof(float));
+    std::memcpy(&k[1], &y, sizeof(float));
+    std::memcpy(&k[2], &z, sizeof(float));
+
+    auto it = lookup.find(k);
+    if (it != lookup.end()) {
+      return it->second;
+    }
+
+    const std::uint32_t index = std::uint32_t(positions.size() / 3);
+    const float v[3] = {x, y, z};
+    for (std::size_t i = 0; i < 3; i++) {
+      if (index == 0 || v[i] < min[i]) {
+        min[i] = v[i];
+      }
+      if (index == 0 || v[i] > max[i]) {
+        max[i] = v[i];
+      }
+      positions.push_back(v[i]);
+    }
+
+    lookup[k] = index;
+    return index;
+  }
+
+  /**\brief Vertex lookup table
+   *
+   * Maps vertex coordinates to indices in the vertex buffer.
+   */
+  std::unordered_map<key, std::uint32_t, hash> lookup;
+
+  /**\brief Vertices per face
+   *
+   * Set by begin().
+   */
+  std::size_t faceVertices;
+
+  /**\brief Bounding box minimum
+   *
+   * glTF requires position accessors to state their bounds.
+   */
+  std::array<float, 3> min;
+
+  /**\brief Bounding box maximum
+   *
+   * glTF requires position accessors to state their bounds.
+   */
+  std::array<float, 3> max;
+};
+}
+}
+
+#endif
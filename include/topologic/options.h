@@ -0,0 +1,705 @@
+/**\file
+ * \brief Command line options
+ *
+ * Matches command line arguments against Topologic's options. Options are
+ * described with patterns in the usual regular expression syntax, but
+ * instead of std::regex, which is slow to construct and to match with, the
+ * patterns are compiled to a small backtracking matcher, once per process.
+ *
+ * Only the parts of the regular expression syntax that Topologic's options
+ * use are supported: literal characters and escapes, '.', bracket
+ * expressions with ranges, capturing groups, alternatives and the '?', '*',
+ * '+' and '{n,m}' quantifiers, which are always greedy. Patterns always have
+ * to match a whole argument, as with std::regex_match().
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_OPTIONS_H)
+#define TOPOLOGIC_OPTIONS_H
+
+#include <bitset>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace topologic {
+/**\brief Compiled argument pattern
+ *
+ * A regular expression, compiled to a program for a backtracking matcher.
+ * See the description of this file for the supported syntax.
+ */
+class pattern {
+public:
+  /**\brief Compile pattern
+   *
+   * Compiles the given regular expression. Patterns that can't be compiled
+   * are marked as not valid and never match anything.
+   *
+   * \param[in] source The regular expression to compile.
+   */
+  pattern(const std::string &source) : groups(0), valid(true) {
+    std::size_t position = 0;
+    const node n = alternatives(source, position);
+    if (position != source.size()) {
+      valid = false;
+    }
+
+    if (valid) {
+      emit(instruction::save, 0);
+      emit(n);
+      emit(instruction::save, 1);
+      emit(instruction::accept);
+    }
+  }
+
+  /**\brief Match argument
+   *
+   * Matches the whole argument against the pattern.
+   *
+   * \param[in]  argument The argument to match.
+   * \param[out] match    Set to the part of the argument that each group
+   *                      matched, like the elements of a std::smatch: the
+   *                      first element is the whole argument, and groups
+   *                      that didn't take part in the match are empty.
+   *
+   * \returns 'true' if the pattern matched the argument.
+   */
+  bool match(const std::string &argument,
+             std::vector<std::string> &match) const {
+    if (!valid) {
+      return false;
+    }
+
+    const char *begin = argument.data();
+    std::vector<const char *> saves((groups + 1) * 2, (const char *)0);
+    if (!run(0, begin, begin + argument.size(), saves)) {
+      return false;
+    }
+
+    match.resize(groups + 1);
+    for (std::size_t i = 0; i <= groups; i++) {
+      if (saves[i * 2] && saves[i * 2 + 1]) {
+        match[i].assign(saves[i * 2], saves[i * 2 + 1]);
+      } else {
+        match[i].clear();
+      }
+    }
+    return true;
+  }
+
+  /**\brief Get compiled pattern
+   *
+   * Compiles the given regular expression, unless it has been compiled
+   * before. Compiled patterns are kept until the process exits, so
+   * repeatedly parsing command lines only compiles each option once. The
+   * cache is shared between threads and guarded by a mutex.
+   *
+   * \param[in] source The regular expression to compile.
+   *
+   * \returns The compiled pattern.
+   */
+  static const pattern &compile(const std::string &source) {
+    static std::mutex mutex;
+    static std::map<std::string, pattern> compiled;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    auto it = compiled.find(source);
+    if (it == compiled.end()) {
+      it = compiled.insert(std::make_pair(source, pattern(source))).first;
+    }
+    return it->second;
+  }
+
+  /**\brief Number of groups
+   *
+   * The number of capturing groups in the pattern.
+   */
+  std::size_t groups;
+
+  /**\brief Was the pattern compiled successfully?
+   *
+   * Set by the constructor.
+   */
+  bool valid;
+
+protected:
+  /**\brief Parsed pattern
+   *
+   * A node in the syntax tree of a pattern, before it is compiled.
+   */
+  struct node {
+    /**\brief Node type
+     *
+     * 'characters' matches one character out of a set, 'group' is a
+     * capturing group with a single child of type 'alternatives', whose
+     * children are of type 'sequence'.
+     */
+    enum kind { characters, group, sequence, alternatives } type;
+
+    /**\brief Character set
+     *
+     * The characters matched by a node of type 'characters'.
+     */
+    std::bitset<256> set;
+
+    /**\brief Group number
+     *
+     * The number of a capturing group, starting at 1.
+     */
+    std::size_t capture;
+
+    /**\brief Repetitions
+     *
+     * How often the node has to match, at least and at most; 'maximum' is
+     * 0 if there is no upper limit.
+     */
+    std::size_t minimum, maximum;
+
+    /**\brief Child nodes
+     *
+     * The elements of a sequence, the alternatives, or a group's content.
+     */
+    std::vector<node> children;
+  };
+
+  /**\brief Matcher instruction
+   *
+   * One instruction of a compiled pattern.
+   */
+  struct instruction {
+    /**\brief Operation
+     *
+     * 'character' consumes a character in 'set', 'split' continues at 'x'
+     * and then at 'y' if that failed, 'jump' continues at 'x', 'save'
+     * records the current position in save slot 'x' and 'accept' succeeds
+     * if the whole argument has been consumed.
+     */
+    enum operation { character, split, jump, save, accept } op;
+
+    /**\brief Character set
+     *
+     * The characters a 'character' instruction consumes.
+     */
+    std::bitset<256> set;
+
+    /**\brief Operands
+     *
+     * Instruction indices or a save slot, depending on the operation.
+     */
+    std::size_t x, y;
+  };
+
+  /**\brief Program
+   *
+   * The compiled pattern.
+   */
+  std::vector<instruction> program;
+
+  /**\brief Parse alternatives
+   *
+   * Parses a list of sequences separated by '|'.
+   *
+   * \param[in]     source   The pattern.
+   * \param[in,out] position Where to start parsing; left after the last
+   *                         alternative.
+   *
+   * \returns The parsed alternatives.
+   */
+  node alternatives(const std::string &source, std::size_t &position) {
+    node n = leaf(node::alternatives);
+    n.children.push_back(sequence(source, position));
+    while ((position < source.size()) && (source[position] == '|')) {
+      position++;
+      n.children.push_back(sequence(source, position));
+    }
+    return n;
+  }
+
+  /**\brief Parse sequence
+   *
+   * Parses a sequence of optionally quantified atoms.
+   *
+   * \param[in]     source   The pattern.
+   * \param[in,out] position Where to start parsing; left after the end of
+   *                         the sequence.
+   *
+   * \returns The parsed sequence.
+   */
+  node sequence(const std::string &source, std::size_t &position) {
+    node n = leaf(node::sequence);
+    while (valid && (position < source.size()) && (source[position] != '|') &&
+           (source[position] != ')')) {
+      n.children.push_back(atom(source, position));
+      quantifier(source, position, n.children.back());
+    }
+    return n;
+  }
+
+  /**\brief Parse atom
+   *
+   * Parses a group, a bracket expression, '.', an escaped character or a
+   * literal character.
+   *
+   * \param[in]     source   The pattern.
+   * \param[in,out] position Where to start parsing; left after the atom.
+   *
+   * \returns The parsed atom.
+   */
+  node atom(const std::string &source, std::size_t &position) {
+    node n = leaf(node::characters);
+    const char c = source[position++];
+
+    if (c == '(') {
+      n.type = node::group;
+      n.capture = ++groups;
+      n.children.push_back(alternatives(source, position));
+      if ((position < source.size()) && (source[position] == ')')) {
+        position++;
+      } else {
+        valid = false;
+      }
+    } else if (c == '[') {
+      const bool negate =
+          (position < source.size()) && (source[position] == '^');
+      if (negate) {
+        position++;
+      }
+      bool first = true;
+      while ((position < source.size()) &&
+             ((source[position] != ']') || first)) {
+        first = false;
+        unsigned char from = source[position++];
+        if ((from == '\\') && (position < source.size())) {
+          from = source[position++];
+        }
+        unsigned char to = from;
+        if ((position + 1 < source.size()) && (source[position] == '-') &&
+            (source[position + 1] != ']')) {
+          to = source[position + 1];
+          position += 2;
+        }
+        for (std::size_t i = from; i <= to; i++) {
+          n.set.set(i);
+        }
+      }
+      if (position < source.size()) {
+        position++;
+      } else {
+        valid = false;
+      }
+      if (negate) {
+        n.set.flip();
+      }
+    } else if (c == '.') {
+      n.set.set();
+      n.set.reset('\n');
+      n.set.reset('\r');
+    } else if ((c == '\\') && (position < source.size())) {
+      n.set.set((unsigned char)source[position++]);
+    } else if ((c == ')') || (c == '?') || (c == '*') || (c == '+') ||
+               (c == '{')) {
+      valid = false;
+    } else {
+      n.set.set((unsigned char)c);
+    }
+
+    return n;
+  }
+
+  /**\brief Parse quantifier
+   *
+   * Parses a quantifier after an atom, if there is one, and applies it to
+   * the atom.
+   *
+   * \param[in]     source   The pattern.
+   * \param[in,out] position Where to start parsing; left after the
+   *                         quantifier.
+   * \param[in,out] n        The atom to apply the quantifier to.
+   */
+  void quantifier(const std::string &source, std::size_t &position,
+                  node &n) {
+    if (position >= source.size()) {
+      return;
+    }
+
+    switch (source[position]) {
+    case '?':
+      n.minimum = 0;
+      break;
+    case '*':
+      n.minimum = 0;
+      n.maximum = 0;
+      break;
+    case '+':
+      n.maximum = 0;
+      break;
+    case '{': {
+      const std::size_t end = source.find('}', position);
+      const std::size_t comma = source.find(',', position);
+      if (end == std::string::npos) {
+        valid = false;
+        return;
+      }
+      n.minimum = std::stoul(source.substr(position + 1));
+      if ((comma == std::string::npos) || (comma > end)) {
+        n.maximum = n.minimum;
+      } else if (comma + 1 == end) {
+        n.maximum = 0;
+      } else {
+        n.maximum = std::stoul(source.substr(comma + 1));
+      }
+      position = end;
+    } break;
+    default:
+      return;
+    }
+
+    position++;
+  }
+
+  /**\brief Create node
+   *
+   * \param[in] type The type of the new node.
+   *
+   * \returns An empty node of the given type, which matches exactly once.
+   */
+  static node leaf(enum node::kind type) {
+    node n;
+    n.type = type;
+    n.capture = 0;
+    n.minimum = 1;
+    n.maximum = 1;
+    return n;
+  }
+
+  /**\brief Append instruction
+   *
+   * \param[in] op The operation.
+   * \param[in] x  The first operand.
+   * \param[in] y  The second operand.
+   *
+   * \returns The index of the new instruction.
+   */
+  std::size_t emit(enum instruction::operation op, std::size_t x = 0,
+                   std::size_t y = 0) {
+    instruction i;
+    i.op = op;
+    i.x = x;
+    i.y = y;
+    program.push_back(i);
+    return program.size() - 1;
+  }
+
+  /**\brief Compile node
+   *
+   * Appends the instructions for the given node, with its repetitions.
+   *
+   * \param[in] n The node to compile.
+   */
+  void emit(const node &n) {
+    for (std::size_t i = 0; i < n.minimum; i++) {
+      once(n);
+    }
+
+    if (n.maximum == 0) {
+      const std::size_t loop = emit(instruction::split, program.size() + 1);
+      once(n);
+      emit(instruction::jump, loop);
+      program[loop].y = program.size();
+    } else if (n.maximum > n.minimum) {
+      std::vector<std::size_t> splits;
+      for (std::size_t i = n.minimum; i < n.maximum; i++) {
+        splits.push_back(emit(instruction::split, program.size() + 1));
+        once(n);
+      }
+      for (const std::size_t s : splits) {
+        program[s].y = program.size();
+      }
+    }
+  }
+
+  /**\brief Compile node once
+   *
+   * Appends the instructions for a single repetition of the given node.
+   *
+   * \param[in] n The node to compile.
+   */
+  void once(const node &n) {
+    switch (n.type) {
+    case node::characters:
+      program[emit(instruction::character)].set = n.set;
+      break;
+    case node::group:
+      emit(instruction::save, n.capture * 2);
+      emit(n.children[0]);
+      emit(instruction::save, n.capture * 2 + 1);
+      break;
+    case node::sequence:
+      for (const node &c : n.children) {
+        emit(c);
+      }
+      break;
+    case node::alternatives: {
+      std::vector<std::size_t> jumps;
+      for (std::size_t i = 0; i < n.children.size(); i++) {
+        std::size_t s = 0;
+        if (i + 1 < n.children.size()) {
+          s = emit(instruction::split, program.size() + 1);
+        }
+        emit(n.children[i]);
+        if (i + 1 < n.children.size()) {
+          jumps.push_back(emit(instruction::jump));
+          program[s].y = program.size();
+        }
+      }
+      for (const std::size_t j : jumps) {
+        program[j].x = program.size();
+      }
+    } break;
+    }
+  }
+
+  /**\brief Run program
+   *
+   * Runs the compiled pattern from the given instruction and position,
+   * backtracking whenever an instruction fails.
+   *
+   * \param[in]     pc    The instruction to start with.
+   * \param[in]     p     The current position in the argument.
+   * \param[in]     end   The end of the argument.
+   * \param[in,out] saves The positions recorded by 'save' instructions.
+   *
+   * \returns 'true' if the rest of the argument matched.
+   */
+  bool run(std::size_t pc, const char *p, const char *end,
+           std::vector<const char *> &saves) const {
+    for (;;) {
+      const instruction &i = program[pc];
+      switch (i.op) {
+      case instruction::character:
+        if ((p == end) || !i.set[(unsigned char)*p]) {
+          return false;
+        }
+        p++;
+        pc++;
+        break;
+      case instruction::split:
+        if (run(i.x, p, end, saves)) {
+          return true;
+        }
+        pc = i.y;
+        break;
+      case instruction::jump:
+        pc = i.x;
+        break;
+      case instruction::save: {
+        const char *previous = saves[i.x];
+        saves[i.x] = p;
+        if (run(pc + 1, p, end, saves)) {
+          return true;
+        }
+        saves[i.x] = previous;
+        return false;
+      }
+      case instruction::accept:
+        return p == end;
+      }
+    }
+  }
+};
+
+class option;
+
+/**\brief Option set
+ *
+ * A list of options that command line arguments are matched against.
+ * There is no global option set; whoever parses arguments owns the set and
+ * the options in it, so independent parsers don't share any state other
+ * than the compiled patterns, which are immutable.
+ */
+class options {
+public:
+  /**\brief Apply options
+   *
+   * Matches each of the arguments, except for the first one, which is the
+   * name the programme was called as, against the options in the set. Each
+   * argument is passed to the first option whose pattern matches it and
+   * whose handler accepts it; arguments that no option accepted are added
+   * to the remainder.
+   *
+   * \param[in] args The argument vector.
+   *
+   * \returns The number of arguments that were accepted by an option.
+   */
+  std::size_t apply(const std::vector<std::string> &args);
+
+  /**\brief Print help
+   *
+   * Writes the patterns and descriptions of all options in the set.
+   *
+   * \param[out] output The stream to write to.
+   *
+   * \returns 'true' if the stream is still good after writing.
+   */
+  bool help(std::ostream &output) const;
+
+  /**\brief Options
+   *
+   * The options in the set, in the order they were added in.
+   */
+  std::vector<const option *> list;
+
+  /**\brief Remaining arguments
+   *
+   * The arguments that weren't accepted by any option, as of the last
+   * call to apply().
+   */
+  std::vector<std::string> remainder;
+};
+
+/**\brief Command line option
+ *
+ * An option with a pattern for the arguments it applies to and a handler
+ * that is called with the groups of the pattern when an argument matches.
+ * Options add themselves to an option set when they are created, and
+ * remove themselves when they are destroyed.
+ */
+class option {
+public:
+  /**\brief Pattern match
+   *
+   * The groups that the pattern matched, as described for pattern::match().
+   */
+  typedef std::vector<std::string> match;
+
+  /**\brief Option handler
+   *
+   * Called with the groups that the pattern matched. Returns 'true' if the
+   * argument was accepted.
+   */
+  typedef std::function<bool(match &)> handler;
+
+  /**\brief Construct with pattern and handler
+   *
+   * \param[in]     pPattern     The pattern for the option's arguments.
+   * \param[in]     pHandler     Called for matching arguments.
+   * \param[in]     pDescription Help text for the option.
+   * \param[in,out] pSet         The option set to add the option to.
+   */
+  option(const std::string &pPattern, handler pHandler,
+         const std::string &pDescription, options &pSet)
+      : expression(pattern::compile(pPattern)), source(pPattern),
+        function(pHandler), description(pDescription), set(pSet) {
+    set.list.push_back(this);
+  }
+
+  /**\brief Copy constructor
+   *
+   * The copy constructor is explicitly deleted, as options are listed in
+   * their set by address.
+   */
+  option(const option &) = delete;
+
+  /**\brief Destructor
+   *
+   * Removes the option from its set.
+   */
+  ~option(void) {
+    for (auto it = set.list.begin(); it != set.list.end(); it++) {
+      if (*it == this) {
+        set.list.erase(it);
+        break;
+      }
+    }
+  }
+
+  /**\brief Apply option to argument
+   *
+   * \param[in]  argument The argument to apply the option to.
+   * \param[out] groups   Scratch space for the groups of the pattern.
+   *
+   * \returns 'true' if the pattern matched and the handler accepted the
+   *          argument.
+   */
+  bool apply(const std::string &argument, match &groups) const {
+    return expression.match(argument, groups) && function(groups);
+  }
+
+  /**\brief Compiled pattern
+   *
+   * The pattern for the option's arguments.
+   */
+  const pattern &expression;
+
+  /**\brief Pattern source
+   *
+   * The pattern as it was passed to the constructor.
+   */
+  const std::string source;
+
+  /**\brief Handler
+   *
+   * Called when an argument matches.
+   */
+  const handler function;
+
+  /**\brief Description
+   *
+   * Help text for the option.
+   */
+  const std::string description;
+
+protected:
+  /**\brief Option set
+   *
+   * The set the option was added to.
+   */
+  options &set;
+};
+
+inline std::size_t options::apply(const std::vector<std::string> &args) {
+  std::size_t accepted = 0;
+  option::match groups;
+
+  remainder.clear();
+  for (std::size_t i = 1; i < args.size(); i++) {
+    bool done = false;
+    for (const option *o : list) {
+      if (o->apply(args[i], groups)) {
+        done = true;
+        break;
+      }
+    }
+    if (done) {
+      accepted++;
+    } else {
+      remainder.push_back(args[i]);
+    }
+  }
+
+  return accepted;
+}
+
+inline bool options::help(std::ostream &output) const {
+  for (const option *o : list) {
+    output << " " << o->source << "\n";
+    if (o->description != "") {
+      output << "   " << o->description << "\n";
+    }
+    output << "\n";
+  }
+  return bool(output);
+}
+}
+
+#endif
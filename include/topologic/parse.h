@@ -17,6 +17,7 @@
 #define TOPOLOGIC_PARSE_H
 
 #include <topologic/state.h>
+#include <topologic/input.h>
 #include <ef.gy/polytope.h>
 #include <ef.gy/parametric.h>
 #include <ef.gy/ifs.h>
@@ -25,11 +26,27 @@
 #if !defined(NOLIBRARIES)
 #include <libxml/tree.h>
 #include <libxml/parser.h>
+#include <libxml/xmlreader.h>
 #include <libxml/xpath.h>
 #include <libxml/xpathInternals.h>
 #endif
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <set>
 #include <sstream>
+#include <thread>
+#include <vector>
+#if defined(__has_include)
+#if __has_include(<charconv>) && (__cplusplus >= 201703L)
+#include <charconv>
+#endif
+#endif
 
 namespace topologic {
 /**\brief Model update functor
@@ -173,28 +190,137 @@ static bool setMatrixCell(state<Q, 1> &, const std::size_t &,
  * This class is a wrapper for the libxml2 XML parser. It is used when
  * reading the model parameters saved to XML files, e.g. to SVGs by the SVG
  * renderer.
+ *
+ * libxml2 is initialised once per process, the first time it is needed,
+ * and cleaned up when the process exits. Each thread keeps its own libxml2
+ * parser contexts and reuses them for every document it reads, so parsing
+ * many documents, possibly in several threads at once, doesn't have to set
+ * up libxml2 over and over again.
  */
 class xml {
 public:
   /**\brief Default constructor
    *
-   * The sole purpose of this destructor is to do whatever the
-   * LIBXML_TEST_VERSION macro does, in order to initialise libxml2.
+   * Initialises libxml2, unless that has already happened. It is not
+   * necessary to create an instance of this class before using the parser
+   * classes, which initialise libxml2 themselves.
+   */
+  xml(void) { initialise(); }
+
+  /**\brief Initialise libxml2
+   *
+   * Does whatever the LIBXML_TEST_VERSION macro does and initialises
+   * libxml2's parser, which has to happen before parsers are used in more
+   * than one thread. This only happens the first time this function is
+   * called; xmlCleanupParser() is called when the process exits.
+   */
+  static void initialise(void) {
+    static class library {
+    public:
+      library(void) {
+        LIBXML_TEST_VERSION
+        xmlInitParser();
+      }
+
+      ~library(void) { xmlCleanupParser(); }
+    } libxml;
+  }
+
+  /**\brief Topologic metadata element
+   *
+   * An element in Topologic's XML namespace, with its attributes. This is
+   * all there is to Topologic's metadata, so these elements are extracted
+   * from the document once and then applied to the state object.
+   */
+  class element {
+  public:
+    /**\brief Element name
+     *
+     * The local name of the element, e.g. "camera".
+     */
+    std::string name;
+
+    /**\brief Attributes
+     *
+     * Maps the local names of the element's attributes to their values.
+     */
+    std::map<std::string, std::string> attributes;
+
+    /**\brief Get attribute value
+     *
+     * \param[in] attribute Local name of the attribute to look up.
+     *
+     * \returns The value of the attribute, or an empty string if the
+     *          element doesn't have the attribute.
+     */
+    std::string operator[](const std::string &attribute) const {
+      const auto it = attributes.find(attribute);
+      return it == attributes.end() ? "" : it->second;
+    }
+  };
+
+  /**\brief Document size limit
+   *
+   * libxml2 takes the size of in-memory documents as an int. Larger
+   * documents are cut off at the largest size that fits, which still
+   * leaves plenty of room for the metadata at the start of a file.
+   *
+   * \param[in] size Size of a document, in bytes.
+   *
+   * \returns The size to pass to libxml2.
    */
-  xml(void) { LIBXML_TEST_VERSION }
+  static int limit(std::size_t size) {
+    return int(std::min<std::size_t>(size, INT_MAX));
+  }
 
-  /**\brief Destructor
+  /**\brief Metadata source
    *
-   * Calls xmlCleanupParser() to deinitialize libxml2.
+   * Base class for the ways to read Topologic's metadata from an XML
+   * document: parsing all of the document with xml::parser, or just as
+   * much as needed with xml::reader.
    */
-  ~xml(void) { xmlCleanupParser(); }
+  class source {
+  public:
+    /**\brief Default constructor
+     *
+     * Sources are invalid until a derived class has loaded a document.
+     */
+    source(void) : valid(false) {}
+
+    /**\brief Virtual destructor
+     *
+     * Generally necessary for virtual classes; stubbed to be a
+     * trivial destructor.
+     */
+    virtual ~source(void) {}
+
+    /**\brief Topologic metadata
+     *
+     * \returns The elements in Topologic's namespace, in document order.
+     */
+    virtual const std::vector<element> &metadata(void) = 0;
+
+    /**\brief Has a valid XML file been loaded?
+     *
+     * Set to 'true' when this parser context has a valid object loaded,
+     * 'false' otherwise. Set by the constructor.
+     */
+    bool valid;
+
+  protected:
+    /**\brief Metadata elements
+     *
+     * The elements in Topologic's namespace, as returned by metadata().
+     */
+    std::vector<element> elements;
+  };
 
   /**\brief XML parser instance
    *
    * Objects of this class are generated by the xml class to provide
    * access to the parsed content of an XML file.
    */
-  class parser {
+  class parser : public source {
   public:
     /**\brief Construct with XML data and file name
      *
@@ -206,41 +332,35 @@ public:
      * \param[in] filename The source location of the document
      */
     parser(const std::string &data, const std::string &filename)
-        : valid(false),
-          document(xmlReadMemory(data.data(), int(data.size()),
-                                 filename.c_str(), 0,
-                                 XML_PARSE_NOERROR | XML_PARSE_NOWARNING)),
-          xpathContext(0) {
+        : parser(data.data(), data.size(), filename) {}
+
+    /**\brief Construct with XML data in memory and file name
+     *
+     * Like the constructor that takes a string, but parses the document
+     * straight from the given block of memory, e.g. a mapped file.
+     *
+     * \param[in] data     A proper, well-formed XML document
+     * \param[in] size     Length of the document, in bytes
+     * \param[in] filename The source location of the document
+     */
+    parser(const char *data, std::size_t size, const std::string &filename)
+        : document(0), xpathContext(0), collected(false) {
+      const xmlParserCtxtPtr context = parserContext();
+      if (context) {
+        document = xmlCtxtReadMemory(context, data, limit(size),
+                                     filename.c_str(), 0,
+                                     XML_PARSE_NOERROR | XML_PARSE_NOWARNING);
+      }
       if (document == 0) {
         std::cerr << "failed to parse xml file " << filename << "\n";
         return;
       }
 
-      xpathContext = xmlXPathNewContext(document);
+      xpathContext = evaluationContext(document);
       if (xpathContext == 0) {
         xmlFreeDoc(document);
         document = 0;
-        std::cerr << "failed to create XPath context\n";
-      }
-
-      if (xmlXPathRegisterNs(xpathContext, (const xmlChar *)"svg",
-                             (const xmlChar *)"http://www.w3.org/2000/svg") !=
-          0) {
-        xmlXPathFreeContext(xpathContext);
-        xpathContext = 0;
-        xmlFreeDoc(document);
-        document = 0;
-        std::cerr << "failed to register namespace: svg\n";
-      }
-
-      if (xmlXPathRegisterNs(xpathContext, (const xmlChar *)"topologic",
-                             (const xmlChar *)"http://ef.gy/2012/topologic") !=
-          0) {
-        xmlXPathFreeContext(xpathContext);
-        xpathContext = 0;
-        xmlFreeDoc(document);
-        document = 0;
-        std::cerr << "failed to register namespace: topologic\n";
+        return;
       }
 
       valid = true;
@@ -255,12 +375,14 @@ public:
 
     /**\brief Destructor
      *
-     * Destroys the XPath and XML document contexts associated with
-     * this instance.
+     * Destroys the XML document associated with this instance, and hands
+     * its XPath context back to the current thread for reuse.
      */
     ~parser(void) {
       if (xpathContext) {
-        xmlXPathFreeContext(xpathContext);
+        xpathContext->doc = 0;
+        xpathContext->node = 0;
+        spareContexts().push_back(xpathContext);
       }
 
       if (document) {
@@ -368,12 +490,39 @@ public:
       return true;
     }
 
-    /**\brief Has a valid XML file been loaded?
+    /**\brief Topologic metadata
      *
-     * Set to 'true' when this parser context has a valid object loaded,
-     * 'false' otherwise. Set by the constructor.
+     * Collects all the elements in Topologic's namespace, in document
+     * order, with a single walk over the document tree. If the document
+     * has metadata elements at the top level - which is where the SVG
+     * renderer puts Topologic's metadata - only those are searched, so
+     * the walk doesn't have to go through all of the model's faces.
+     *
+     * The elements are only collected the first time this is called.
+     *
+     * \returns The metadata elements in the document.
      */
-    bool valid;
+    const std::vector<element> &metadata(void) {
+      if (!collected && document) {
+        collected = true;
+
+        xmlNodePtr root = xmlDocGetRootElement(document);
+        bool found = false;
+        for (xmlNodePtr n = root ? root->children : 0; n; n = n->next) {
+          if ((n->type == XML_ELEMENT_NODE) &&
+              xmlStrEqual(n->name, (const xmlChar *)"metadata")) {
+            collect(n);
+            found = true;
+          }
+        }
+
+        if (!found && root) {
+          collect(root);
+        }
+      }
+
+      return elements;
+    }
 
   protected:
     /**\brief libxml2 document context
@@ -391,6 +540,45 @@ public:
      */
     xmlXPathContextPtr xpathContext;
 
+    /**\brief Have the metadata elements been collected?
+     *
+     * Set by metadata() once it has walked the document.
+     */
+    bool collected;
+
+    /**\brief Collect metadata elements
+     *
+     * Appends the descendants of the given node that are in Topologic's
+     * namespace to the list of metadata elements. Topologic's elements
+     * don't nest, so their children aren't searched.
+     *
+     * \param[in] node The node whose descendants to search.
+     */
+    void collect(xmlNodePtr node) {
+      for (xmlNodePtr n = node->children; n; n = n->next) {
+        if (n->type != XML_ELEMENT_NODE) {
+          continue;
+        }
+
+        if (!n->ns ||
+            !xmlStrEqual(n->ns->href,
+                         (const xmlChar *)"http://ef.gy/2012/topologic")) {
+          collect(n);
+          continue;
+        }
+
+        element e;
+        e.name = (const char *)n->name;
+        for (xmlAttrPtr a = n->properties; a; a = a->next) {
+          xmlChar *value = xmlNodeListGetString(document, a->children, 1);
+          e.attributes[(const char *)a->name] =
+              value ? (const char *)value : "";
+          xmlFree(value);
+        }
+        elements.push_back(e);
+      }
+    }
+
     /**\brief Evaluate XPath expression
      *
      * This method will evaluate the given XPath expression in the
@@ -404,211 +592,468 @@ public:
      * \returns The result of the XPath expression after evaluation.
      */
     xmlXPathObjectPtr lookup(const std::string &expression) {
-      xmlXPathObjectPtr xpathObject = xmlXPathEvalExpression(
-          (const xmlChar *)expression.c_str(), xpathContext);
+      const xmlXPathCompExprPtr compiled = compile(expression);
+      xmlXPathObjectPtr xpathObject =
+          compiled ? xmlXPathCompiledEval(compiled, xpathContext) : 0;
       if (xpathObject == 0) {
         std::cerr << "failed to evaluate XPath expression\n";
       }
 
       return xpathObject;
     }
+
+    /**\brief Per-thread parser context
+     *
+     * Each thread keeps a libxml2 parser context around and reuses it for
+     * every document it parses. The context is freed when the thread exits.
+     *
+     * \returns The current thread's parser context, or 0 if it couldn't be
+     *          created.
+     */
+    static xmlParserCtxtPtr parserContext(void) {
+      initialise();
+
+      static thread_local class holder {
+      public:
+        holder(void) : context(xmlNewParserCtxt()) {}
+
+        ~holder(void) {
+          if (context) {
+            xmlFreeParserCtxt(context);
+          }
+        }
+
+        const xmlParserCtxtPtr context;
+      } thread;
+
+      return thread.context;
+    }
+
+    /**\brief Spare XPath contexts
+     *
+     * XPath contexts of parser instances that have been destroyed in the
+     * current thread, with Topologic's namespace prefixes still registered.
+     * They are freed when the thread exits.
+     *
+     * \returns The current thread's spare XPath contexts.
+     */
+    static std::vector<xmlXPathContextPtr> &spareContexts(void) {
+      static thread_local class holder {
+      public:
+        ~holder(void) {
+          for (auto &c : contexts) {
+            xmlXPathFreeContext(c);
+          }
+        }
+
+        std::vector<xmlXPathContextPtr> contexts;
+      } thread;
+
+      return thread.contexts;
+    }
+
+    /**\brief Get XPath context for document
+     *
+     * Reuses one of the current thread's spare XPath contexts, if there is
+     * one, or creates a new one and registers the svg and topologic
+     * namespace prefixes with it.
+     *
+     * \param[in] doc The document that XPath expressions are evaluated on.
+     *
+     * \returns An XPath context for the document, or 0 if it couldn't be
+     *          created.
+     */
+    static xmlXPathContextPtr evaluationContext(xmlDocPtr doc) {
+      std::vector<xmlXPathContextPtr> &spare = spareContexts();
+      if (!spare.empty()) {
+        const xmlXPathContextPtr context = spare.back();
+        spare.pop_back();
+        context->doc = doc;
+        return context;
+      }
+
+      const xmlXPathContextPtr context = xmlXPathNewContext(doc);
+      if (context == 0) {
+        std::cerr << "failed to create XPath context\n";
+        return 0;
+      }
+
+      if (xmlXPathRegisterNs(context, (const xmlChar *)"svg",
+                             (const xmlChar *)"http://www.w3.org/2000/svg") !=
+          0) {
+        xmlXPathFreeContext(context);
+        std::cerr << "failed to register namespace: svg\n";
+        return 0;
+      }
+
+      if (xmlXPathRegisterNs(context, (const xmlChar *)"topologic",
+                             (const xmlChar *)"http://ef.gy/2012/topologic") !=
+          0) {
+        xmlXPathFreeContext(context);
+        std::cerr << "failed to register namespace: topologic\n";
+        return 0;
+      }
+
+      return context;
+    }
+
+    /**\brief Compile XPath expression
+     *
+     * Compiles the given XPath expression, unless it has been compiled
+     * before, by any parser instance. Topologic only ever uses a handful of
+     * different expressions, so compiled expressions are kept until the
+     * process exits; compiling them is much more expensive than evaluating
+     * them.
+     *
+     * Namespace prefixes are only resolved when a compiled expression is
+     * evaluated, so the same compiled expression works with every parser
+     * instance. The cache is shared between threads and guarded by a mutex.
+     *
+     * \param[in] expression The XPath expression to compile.
+     *
+     * \returns The compiled expression, or 0 if the expression is invalid.
+     */
+    static xmlXPathCompExprPtr compile(const std::string &expression) {
+      static class cache {
+      public:
+        ~cache(void) {
+          for (auto &c : expressions) {
+            xmlXPathFreeCompExpr(c.second);
+          }
+        }
+
+        std::mutex mutex;
+        std::map<std::string, xmlXPathCompExprPtr> expressions;
+      } compiled;
+
+      std::lock_guard<std::mutex> lock(compiled.mutex);
+
+      const auto it = compiled.expressions.find(expression);
+      if (it != compiled.expressions.end()) {
+        return it->second;
+      }
+
+      const xmlXPathCompExprPtr rv =
+          xmlXPathCompile((const xmlChar *)expression.c_str());
+      if (rv) {
+        compiled.expressions[expression] = rv;
+      }
+
+      return rv;
+    }
+  };
+
+  /**\brief Streaming metadata reader
+   *
+   * Reads Topologic's metadata from an XML document without building a
+   * document tree. The document is read a chunk at a time, and reading
+   * stops at the end of the first metadata element that had
+   * any of Topologic's elements in it. The SVG renderer writes its
+   * metadata before any of the model's faces, so only the first few
+   * kilobytes of an SVG ever get read, no matter how large the file is.
+   *
+   * Since the rest of the document is never read, it is not checked for
+   * errors either.
+   */
+  class reader : public source {
+  public:
+    /**\brief Construct with XML data in memory and file name
+     *
+     * Reads Topologic's metadata from the given block of memory, using
+     * the given file name as a basis for relative references. If the
+     * memory is a mapped file, only the parts of the file that are read
+     * are ever loaded from disk.
+     *
+     * \param[in] data     A proper, well-formed XML document
+     * \param[in] size     Length of the document, in bytes
+     * \param[in] filename The source location of the document
+     */
+    reader(const char *data, std::size_t size, const std::string &filename) {
+      const xmlTextReaderPtr r = textReader(data, size, filename);
+      if (r == 0) {
+        return;
+      }
+
+      int status;
+      while ((status = xmlTextReaderRead(r)) == 1) {
+        const int type = xmlTextReaderNodeType(r);
+        if ((type == XML_READER_TYPE_END_ELEMENT) && !elements.empty() &&
+            xmlStrEqual(xmlTextReaderConstLocalName(r),
+                        (const xmlChar *)"metadata")) {
+          break;
+        }
+
+        if ((type != XML_READER_TYPE_ELEMENT) ||
+            !xmlStrEqual(xmlTextReaderConstNamespaceUri(r),
+                         (const xmlChar *)"http://ef.gy/2012/topologic")) {
+          continue;
+        }
+
+        element e;
+        e.name = (const char *)xmlTextReaderConstLocalName(r);
+        while (xmlTextReaderMoveToNextAttribute(r) == 1) {
+          if (!xmlTextReaderIsNamespaceDecl(r)) {
+            e.attributes[(const char *)xmlTextReaderConstLocalName(r)] =
+                (const char *)xmlTextReaderConstValue(r);
+          }
+        }
+        xmlTextReaderMoveToElement(r);
+        elements.push_back(e);
+      }
+
+      valid = (status != -1);
+      xmlTextReaderClose(r);
+    }
+
+    /**\brief Copy constructor
+     *
+     * The copy constructor is explicitly deleted, for consistency with
+     * xml::parser.
+     */
+    reader(const reader &) = delete;
+
+    /**\copydoc source::metadata
+     *
+     * The elements are all read by the constructor.
+     */
+    const std::vector<element> &metadata(void) { return elements; }
+
+  protected:
+    /**\brief Per-thread text reader
+     *
+     * Each thread keeps a libxml2 text reader around and reuses it for
+     * every document it reads. The reader is freed when the thread exits.
+     *
+     * \param[in] data     The document to read.
+     * \param[in] size     Length of the document, in bytes
+     * \param[in] filename The source location of the document
+     *
+     * \returns The current thread's text reader, set up to read the given
+     *          document, or 0 if that didn't work.
+     */
+    static xmlTextReaderPtr textReader(const char *data, std::size_t size,
+                                       const std::string &filename) {
+      initialise();
+
+      static thread_local class holder {
+      public:
+        holder(void) : reader(0) {}
+
+        ~holder(void) {
+          if (reader) {
+            xmlFreeTextReader(reader);
+          }
+        }
+
+        xmlTextReaderPtr reader;
+      } thread;
+
+      const int options = XML_PARSE_NOERROR | XML_PARSE_NOWARNING;
+      if (thread.reader &&
+          (xmlReaderNewMemory(thread.reader, data, limit(size),
+                              filename.c_str(), 0, options) != 0)) {
+        xmlFreeTextReader(thread.reader);
+        thread.reader = 0;
+      }
+
+      if (thread.reader == 0) {
+        thread.reader = xmlReaderForMemory(data, limit(size), filename.c_str(),
+                                           0, options);
+      }
+
+      return thread.reader;
+    }
   };
 };
 
-/**\brief Parse XML file contents and update global state object
+/**\brief Apply XML metadata element to state object
  *
- * This function uses an xml::parser instance to update a topologic::state
- * instance with the metadata contained in the XML document. The parser is
- * fairly tolerant of the input XML's layout and will accept tags in
- * topologic's namespace almost everywhere. You should probably still use a
- * designated metadata element in your XML files, such as the svg:metadata
- * element.
+ * Updates a topologic::state instance with the contents of a single
+ * element of Topologic's XML metadata. The element is passed down through
+ * the dimensions of the state object until it reaches the one it applies
+ * to: cameras are matched by their number of attributes, which is the
+ * number of coordinates they have, and transformation matrices either by
+ * their depth attribute or by their number of cells.
  *
  * \tparam Q Base data type for calculations.
  * \tparam d Maximum number of dimensions supported by the given state
  *           instance
  *
- * \param[out] s      The global state object to update.
- * \param[out] parser An XML parser instance, hopefully containing
- *                    Topologic metadata.
+ * \param[out] s The global state object to update.
+ * \param[in]  e The metadata element to apply.
  *
- * \returns 'true' if the code didn't blow up trying to parse your XML,
- *          'false' if it did. Probably.
+ * \returns 'true' if the element was applied to the state object, 'false'
+ *          if it wasn't recognised.
  */
 template <typename Q, std::size_t d>
-static bool parse(state<Q, d> &s, xml::parser &parser) {
-  if (!parser.valid) {
-    return false;
-  }
+static bool parse(state<Q, d> &s, const xml::element &e) {
+  std::string value;
 
-  std::stringstream st;
-  std::string value, dims, dimssq;
-  st << d;
-  st >> dims;
-  st.clear();
-  st.str("");
-  st << ((d + 1) * (d + 1));
-  st >> dimssq;
-  st.clear();
+  if ((e.name == "camera") && (e.attributes.size() == d)) {
+    for (std::size_t i = 0; i < d; i++) {
+      std::ostringstream name("");
+      if ((i == 0) && ((value = e["radius"]) != "")) {
+        s.fromp[0] = Q(std::stold(value));
+        continue;
+      }
 
-  if (parser.updateContext("//topologic:camera[count(@*) = " + dims + "][1]")) {
-    do {
-      for (std::size_t i = 0; i < d; i++) {
-        if ((i == 0) && ((value = parser.evaluate("@radius")) != "")) {
-          s.fromp[0] = Q(std::stold(value));
-          continue;
-        } else {
-          st.str("");
-          st << "@theta-" << i;
-          if ((value = parser.evaluate(st.str())) != "") {
-            s.fromp[i] = Q(std::stold(value));
-            continue;
-          }
-        }
+      name << "theta-" << i;
+      if ((value = e[name.str()]) != "") {
+        s.fromp[i] = Q(std::stold(value));
+        continue;
+      }
 
-        if (i < sizeof(cartesianDimensions)) {
-          char r[] = {'@', cartesianDimensions[i], 0};
-          if ((value = parser.evaluate(r)) != "") {
-            s.from[i] = Q(std::stold(value));
-          }
-        } else {
-          st.str("");
-          st << "@d-" << i;
-          if ((value = parser.evaluate(st.str())) != "") {
-            s.from[i] = Q(std::stold(value));
-          }
-        }
+      name.str("");
+      if (i < sizeof(cartesianDimensions)) {
+        name << cartesianDimensions[i];
+      } else {
+        name << "d-" << i;
+      }
+      if ((value = e[name.str()]) != "") {
+        s.from[i] = Q(std::stold(value));
       }
-    } while (parser.updateContext(
-        "following-sibling::topologic:camera[count(@*) = " + dims + "][1]"));
+    }
+    return true;
   }
 
-  if (parser.updateContext("//topologic:transformation[@depth = " + dims +
-                           "][1]")) {
-    do {
-      if ((value = parser.evaluate("@matrix")) == "identity") {
+  if (e.name == "transformation") {
+    if ((value = e["depth"]) != "") {
+      if (std::strtoul(value.c_str(), 0, 10) != d) {
+        return parse<Q, d - 1>(s, e);
+      }
+      if (e["matrix"] == "identity") {
         s.transformation = efgy::geometry::transformation::affine<Q, d>();
       }
-    } while (parser.updateContext(
-        "following-sibling::topologic:transformation[@depth = " + dims +
-        "][1]"));
-  }
+      return true;
+    }
 
-  if (parser.updateContext("//topologic:transformation[count(@*) = " + dimssq +
-                           "][1]")) {
-    do {
+    if (e.attributes.size() == ((d + 1) * (d + 1))) {
       for (std::size_t i = 0; i <= d; i++) {
         for (std::size_t j = 0; j <= d; j++) {
-          st.str("");
-          st << "@e" << i << "-" << j;
-          if ((value = parser.evaluate(st.str())) != "") {
+          std::ostringstream name("");
+          name << "e" << i << "-" << j;
+          if ((value = e[name.str()]) != "") {
             s.transformation.matrix[i][j] = Q(std::stold(value));
           }
         }
       }
-    } while (parser.updateContext(
-        "following-sibling::topologic:transformation[count(@*) = " + dimssq +
-        "][1]"));
+      return true;
+    }
   }
 
-  return parse<Q, d - 1>(s, parser);
+  return parse<Q, d - 1>(s, e);
 }
 
-/**\brief Parse XML file contents and update global state object; 1D fix
- *        point.
- *
- * This function uses an xml::parser instance to update a topologic::state
- * instance with the metadata contained in the XML document. The parser is
- * fairly tolerant of the input XML's layout and will accept tags in
- * topologic's namespace almost everywhere. You should probably still use a
- * designated metadata element in your XML files, such as the svg:metadata
- * element.
+/**\brief Apply XML metadata element to state object; 1D fix point
  *
- * This process is applied recursively, and this is the 1D fix point, which
- * makes certain that the compiler won't blow up due to infinite template
- * recursion.
+ * Updates a topologic::state instance with the contents of a single
+ * element of Topologic's XML metadata. This is the 1D fix point, which
+ * handles the settings that apply to all dimensions.
  *
  * \tparam Q Base data type for calculations.
  * \tparam d Maximum number of dimensions supported by the given state
  *           instance
  *
- * \param[out] s      The global state object to update.
- * \param[out] parser An XML parser instance, hopefully containing
- *                    Topologic metadata.
+ * \param[out] s The global state object to update.
+ * \param[in]  e The metadata element to apply.
  *
- * \returns 'true' if the code didn't blow up trying to parse your XML,
+ * \returns 'true' if the element was applied to the state object, 'false'
+ *          if it wasn't recognised.
+ */
+template <typename Q, std::size_t d>
+static bool parse(state<Q, 1> &s, const xml::element &e) {
+  std::string value;
+
+  if (e.name == "camera") {
+    if ((value = e["mode"]) != "") {
+      s.polarCoordinates = (value == "polar");
+    }
+  } else if (e.name == "precision") {
+    if ((value = e["polar"]) != "") {
+      s.parameter.precision = Q(std::stold(value));
+    }
+  } else if (e.name == "options") {
+    if ((value = e["radius"]) != "") {
+      s.parameter.radius = Q(std::stold(value));
+    }
+  } else if ((e.name == "colour-background") ||
+             (e.name == "colour-wireframe") || (e.name == "colour-surface")) {
+    auto &colour = e.name == "colour-background"
+                       ? s.background
+                       : e.name == "colour-wireframe" ? s.wireframe
+                                                      : s.surface;
+    if ((value = e["red"]) != "") {
+      colour.red = Q(std::stold(value));
+    }
+    if ((value = e["green"]) != "") {
+      colour.green = Q(std::stold(value));
+    }
+    if ((value = e["blue"]) != "") {
+      colour.blue = Q(std::stold(value));
+    }
+    if ((value = e["alpha"]) != "") {
+      colour.alpha = Q(std::stold(value));
+    }
+  } else if (e.name == "ifs") {
+    if ((value = e["iterations"]) != "") {
+      s.parameter.iterations = Q(std::stold(value));
+    }
+    if ((value = e["seed"]) != "") {
+      s.parameter.seed = Q(std::stold(value));
+    }
+    if ((value = e["functions"]) != "") {
+      s.parameter.functions = Q(std::stold(value));
+    }
+    if ((value = e["pre-rotate"]) != "") {
+      s.parameter.preRotate = (value == "yes");
+    }
+    if ((value = e["post-rotate"]) != "") {
+      s.parameter.postRotate = (value == "yes");
+    }
+  } else if (e.name == "flame") {
+    if ((value = e["coefficients"]) != "") {
+      s.parameter.flameCoefficients = Q(std::stold(value));
+    }
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+/**\brief Parse XML file contents and update global state object
+ *
+ * This function uses an xml::parser instance to update a topologic::state
+ * instance with the metadata contained in the XML document. The parser is
+ * fairly tolerant of the input XML's layout and will accept tags in
+ * topologic's namespace almost everywhere. You should probably still use a
+ * designated metadata element in your XML files, such as the svg:metadata
+ * element.
+ *
+ * The metadata elements are applied in document order, so if there's more
+ * than one element for the same setting, the last one wins.
+ *
+ * \tparam Q Base data type for calculations.
+ * \tparam d Maximum number of dimensions supported by the given state
+ *           instance
+ *
+ * \param[out] s      The global state object to update.
+ * \param[out] parser An XML parser or reader, hopefully containing
+ *                    Topologic metadata.
+ *
+ * \returns 'true' if the code didn't blow up trying to parse your XML,
  *          'false' if it did. Probably.
  */
 template <typename Q, std::size_t d>
-static bool parse(state<Q, 1> &s, xml::parser &parser) {
+static bool parse(state<Q, d> &s, xml::source &parser) {
   if (!parser.valid) {
     return false;
   }
 
-  std::string value;
-  if ((value = parser.evaluate("//topologic:precision/@polar")) != "") {
-    s.parameter.precision = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:options/@radius")) != "") {
-    s.parameter.radius = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:camera/@mode[1]")) != "") {
-    s.polarCoordinates = (value == "polar");
-  }
-  if ((value = parser.evaluate("//topologic:colour-background/@red")) != "") {
-    s.background.red = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:colour-background/@green")) != "") {
-    s.background.green = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:colour-background/@blue")) != "") {
-    s.background.blue = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:colour-background/@alpha")) != "") {
-    s.background.alpha = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:colour-wireframe/@red")) != "") {
-    s.wireframe.red = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:colour-wireframe/@green")) != "") {
-    s.wireframe.green = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:colour-wireframe/@blue")) != "") {
-    s.wireframe.blue = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:colour-wireframe/@alpha")) != "") {
-    s.wireframe.alpha = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:colour-surface/@red")) != "") {
-    s.surface.red = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:colour-surface/@green")) != "") {
-    s.surface.green = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:colour-surface/@blue")) != "") {
-    s.surface.blue = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:colour-surface/@alpha")) != "") {
-    s.surface.alpha = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:ifs/@iterations")) != "") {
-    s.parameter.iterations = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:ifs/@seed")) != "") {
-    s.parameter.seed = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:ifs/@functions")) != "") {
-    s.parameter.functions = Q(std::stold(value));
-  }
-  if ((value = parser.evaluate("//topologic:ifs/@pre-rotate")) != "") {
-    s.parameter.preRotate = (value == "yes");
-  }
-  if ((value = parser.evaluate("//topologic:ifs/@post-rotate")) != "") {
-    s.parameter.postRotate = (value == "yes");
-  }
-  if ((value = parser.evaluate("//topologic:flame/@coefficients")) != "") {
-    s.parameter.flameCoefficients = Q(std::stold(value));
+  for (const xml::element &e : parser.metadata()) {
+    parse<Q, d>(s, e);
   }
+
   return true;
 }
 
@@ -630,7 +1075,7 @@ static bool parse(state<Q, 1> &s, xml::parser &parser) {
  *              topologic::updateModel
  *
  * \param[out] s      The global state object to update.
- * \param[out] parser An XML parser instance, hopefully containing
+ * \param[out] parser An XML parser or reader, hopefully containing
  *                    Topologic metadata.
  *
  * \returns 'true' if things worked out, 'false' otherwise.
@@ -638,178 +1083,908 @@ static bool parse(state<Q, 1> &s, xml::parser &parser) {
 template <typename Q, std::size_t d,
           template <typename, template <class, std::size_t> class,
                     std::size_t, std::size_t, typename> class func>
-static bool parseModel(state<Q, d> &s, xml::parser &parser) {
+static bool parseModel(state<Q, d> &s, xml::source &parser) {
   if (!parser.valid) {
     return false;
   }
 
-  std::string format = "cartesian", value;
-  if ((value = parser.evaluate("//topologic:coordinates/@format")) != "") {
-    format = value;
+  std::string format = "cartesian", type, value;
+  int depth = 0, rdepth = 0;
+  for (const xml::element &e : parser.metadata()) {
+    if ((e.name == "coordinates") && ((value = e["format"]) != "")) {
+      format = value;
+    } else if ((e.name == "model") && (e["depth"] != "") &&
+               (e["type"] != "")) {
+      depth = std::stoi(e["depth"]);
+      rdepth = depth;
+      type = e["type"];
+      if ((value = e["render-depth"]) != "") {
+        rdepth = std::stoi(value);
+      }
+    }
+  }
+
+  if (type == "") {
+    return false;
+  }
+
+  if (rdepth == 0) {
+    rdepth = depth;
+    if ((type == "sphere") || (type == "moebius-strip") ||
+        (type == "klein-bagle"))
+      rdepth++;
+  }
+
+  return efgy::geometry::with<Q, func, d>(s, format, type, depth, rdepth);
+}
+#endif
+
+/**\brief JSON state reader
+ *
+ * A small JSON reader for Topologic's state files, which reads values
+ * straight from a block of memory - such as a mapped file - instead of
+ * building a tree of JSON values first. It only provides the primitives
+ * that topologic::parseJSON() needs to pick out the values it knows about
+ * and skip over everything else.
+ *
+ * Numbers are converted with std::from_chars() where the standard library
+ * has it, and with std::strtod() otherwise.
+ */
+class jsonReader {
+public:
+  /**\brief Construct with JSON data
+   *
+   * \param[in] data The JSON data to read; doesn't need to be terminated
+   *                 with a null byte.
+   * \param[in] size Length of the data, in bytes.
+   */
+  jsonReader(const char *data, std::size_t size)
+      : position(data), end(data + size) {}
+
+  /**\brief Read character
+   *
+   * Skips whitespace, then reads the given character if it's next.
+   *
+   * \param[in] c The character to read, e.g. '{'.
+   *
+   * \returns 'true' if the character was next and has been read.
+   */
+  bool next(char c) {
+    whitespace();
+    if ((position < end) && (*position == c)) {
+      position++;
+      return true;
+    }
+    return false;
+  }
+
+  /**\brief Check next character
+   *
+   * Skips whitespace, then checks whether the given character is next,
+   * without reading it.
+   *
+   * \param[in] c The character to look for.
+   *
+   * \returns 'true' if the character is next.
+   */
+  bool peek(char c) {
+    whitespace();
+    return (position < end) && (*position == c);
   }
 
-  if (parser.updateContext("//topologic:model[@depth][@type][1]")) {
-    int depth = std::stoi(parser.evaluate("@depth"));
-    int rdepth = depth;
-    std::string type = parser.evaluate("@type");
-    std::string value = parser.evaluate("@render-depth");
-    if (value != "") {
-      rdepth = std::stoi(value);
+  /**\brief At end of data?
+   *
+   * \returns 'true' if there is nothing but whitespace left to read.
+   */
+  bool done(void) {
+    whitespace();
+    return position == end;
+  }
+
+  /**\brief Read literal
+   *
+   * Reads one of the literals 'true', 'false' or 'null', if it's next.
+   *
+   * \param[in] literal The literal to read.
+   *
+   * \returns 'true' if the literal was next and has been read.
+   */
+  bool next(const std::string &literal) {
+    whitespace();
+    if ((std::size_t(end - position) >= literal.size()) &&
+        std::equal(literal.begin(), literal.end(), position)) {
+      position += literal.size();
+      return true;
     }
+    return false;
+  }
 
-    if (rdepth == 0) {
-      rdepth = depth;
-      if ((type == "sphere") || (type == "moebius-strip") ||
-          (type == "klein-bagle"))
-        rdepth++;
+  /**\brief Read number
+   *
+   * Reads a number, if the next value is one.
+   *
+   * \param[out] value Set to the number that was read.
+   *
+   * \returns 'true' if a number was next and has been read.
+   */
+  bool number(double &value) {
+    whitespace();
+    const char *e = position;
+    while ((e < end) && (((*e >= '0') && (*e <= '9')) || (*e == '-') ||
+                         (*e == '+') || (*e == '.') || (*e == 'e') ||
+                         (*e == 'E'))) {
+      e++;
+    }
+    if ((e == position) || (*position == '+')) {
+      return false;
     }
 
-    return efgy::geometry::with<Q, func, d>(s, format, type, depth, rdepth);
+#if defined(__cpp_lib_to_chars)
+    const auto r = std::from_chars(position, e, value);
+    if (r.ptr != e) {
+      return false;
+    } else if (r.ec == std::errc::result_out_of_range) {
+      // from_chars() doesn't set the value if it's out of range, whereas
+      // strtod() clamps it to infinity or zero, so use that instead.
+      value = std::strtod(std::string(position, e).c_str(), 0);
+    } else if (r.ec != std::errc()) {
+      return false;
+    }
+#else
+    // strtod() needs a terminated string, and the data may not have a
+    // null byte after the number.
+    const std::string text(position, e);
+    char *p;
+    value = std::strtod(text.c_str(), &p);
+    if (p != text.c_str() + text.size()) {
+      return false;
+    }
+#endif
+
+    position = e;
+    return true;
+  }
+
+  /**\brief Read string
+   *
+   * Reads a string, if the next value is one, resolving escape sequences.
+   *
+   * \param[out] value Set to the string that was read.
+   *
+   * \returns 'true' if a string was next and has been read.
+   */
+  bool string(std::string &value) {
+    if (!next('"')) {
+      return false;
+    }
+
+    value.clear();
+    while (position < end) {
+      const char c = *(position++);
+      if (c == '"') {
+        return true;
+      } else if (c != '\\') {
+        value.push_back(c);
+      } else if (position == end) {
+        return false;
+      } else {
+        const char x = *(position++);
+        switch (x) {
+        case 'b':
+          value.push_back('\b');
+          break;
+        case 'f':
+          value.push_back('\f');
+          break;
+        case 'n':
+          value.push_back('\n');
+          break;
+        case 'r':
+          value.push_back('\r');
+          break;
+        case 't':
+          value.push_back('\t');
+          break;
+        case 'u': {
+          if (end - position < 4) {
+            return false;
+          }
+          char hex[5] = {position[0], position[1], position[2], position[3],
+                         0};
+          char *p;
+          const unsigned long u = std::strtoul(hex, &p, 16);
+          if (p != hex + 4) {
+            return false;
+          }
+          position += 4;
+          // Topologic's own strings are plain ASCII; anything else is
+          // passed through as UTF-8, one code unit at a time.
+          if (u < 0x80) {
+            value.push_back(char(u));
+          } else if (u < 0x800) {
+            value.push_back(char(0xc0 | (u >> 6)));
+            value.push_back(char(0x80 | (u & 0x3f)));
+          } else {
+            value.push_back(char(0xe0 | (u >> 12)));
+            value.push_back(char(0x80 | ((u >> 6) & 0x3f)));
+            value.push_back(char(0x80 | (u & 0x3f)));
+          }
+        } break;
+        default:
+          value.push_back(x);
+        }
+      }
+    }
+
+    return false;
+  }
+
+  /**\brief Read array of numbers
+   *
+   * Reads an array, if the next value is one. Elements that aren't numbers
+   * are skipped and show up as NaN, which JSON numbers can't be.
+   *
+   * \param[out] values Set to the elements of the array.
+   *
+   * \returns 'true' if an array was next and has been read.
+   */
+  bool numbers(std::vector<double> &values) {
+    if (!next('[')) {
+      return false;
+    }
+
+    values.clear();
+    if (next(']')) {
+      return true;
+    }
+    do {
+      double v;
+      if (number(v)) {
+        values.push_back(v);
+      } else if (skip()) {
+        values.push_back(std::nan(""));
+      } else {
+        return false;
+      }
+    } while (next(','));
+
+    return next(']');
   }
 
+  /**\brief Skip value
+   *
+   * Reads the next value, whatever it is, without keeping it.
+   *
+   * \param[in] depth How deeply the value is nested in other values;
+   *                  values nested too deeply are rejected, so malicious
+   *                  input can't exhaust the stack.
+   *
+   * \returns 'true' if a valid value was next and has been read.
+   */
+  bool skip(std::size_t depth = 0) {
+    std::string s;
+    double v;
+
+    if (depth > 256) {
+      return false;
+    } else if (next('[')) {
+      if (next(']')) {
+        return true;
+      }
+      do {
+        if (!skip(depth + 1)) {
+          return false;
+        }
+      } while (next(','));
+      return next(']');
+    } else if (next('{')) {
+      if (next('}')) {
+        return true;
+      }
+      do {
+        if (!string(s) || !next(':') || !skip(depth + 1)) {
+          return false;
+        }
+      } while (next(','));
+      return next('}');
+    }
+
+    return string(s) || number(v) || next("true") || next("false") ||
+           next("null");
+  }
+
+protected:
+  /**\brief Skip whitespace
+   *
+   * Moves past any whitespace at the current position.
+   */
+  void whitespace(void) {
+    while ((position < end) && ((*position == ' ') || (*position == '\t') ||
+                                (*position == '\n') || (*position == '\r'))) {
+      position++;
+    }
+  }
+
+  /**\brief Current position
+   *
+   * The next character to read.
+   */
+  const char *position;
+
+  /**\brief End of data
+   *
+   * Points just past the last character of the data.
+   */
+  const char *end;
+};
+
+/**\brief Set camera from JSON coordinates
+ *
+ * Sets the 'from' point of the dimension with as many coordinates as were
+ * given. NaN coordinates are left as they were.
+ *
+ * \tparam Q Base data type for calculations.
+ * \tparam d Maximum number of dimensions supported by the given state
+ *           instance
+ *
+ * \param[out] s      The state object instance to modify.
+ * \param[in]  c      The coordinates to set.
+ * \param[in]  polar  Whether the coordinates are polar coordinates.
+ *
+ * \returns 'true' if a camera was updated, 'false' if not.
+ */
+template <typename Q, std::size_t d>
+static bool setCamera(state<Q, d> &s, const std::vector<double> &c,
+                      bool polar) {
+  if (c.size() != d) {
+    return setCamera<Q, d - 1>(s, c, polar);
+  }
+
+  for (std::size_t i = 0; i < d; i++) {
+    if (std::isnan(c[i])) {
+      continue;
+    } else if (polar) {
+      s.fromp[i] = Q(c[i]);
+    } else {
+      s.from[i] = Q(c[i]);
+    }
+  }
+
+  return true;
+}
+
+/**\brief Set camera from JSON coordinates; 1D fix point
+ *
+ * There is no camera in 1D, so this doesn't do anything.
+ *
+ * \tparam Q Base data type for calculations.
+ * \tparam d Maximum number of dimensions supported by the given state
+ *           instance
+ *
+ * \returns 'false', as no camera was updated.
+ */
+template <typename Q, std::size_t d>
+static bool setCamera(state<Q, 1> &, const std::vector<double> &, bool) {
   return false;
 }
-#endif
 
-/**\brief Parse JSON file contents and update global state object
+/**\brief Set transformation from JSON matrix cells
  *
- * This is analogous to topologic::parse() with XML data; however, this
- * parses a JSON value instead of querying an XML parser.
+ * Sets the transformation matrix of the dimension with as many cells as
+ * were given, which are given row by row. NaN cells are left as they were.
  *
  * \tparam Q Base data type for calculations.
  * \tparam d Maximum number of dimensions supported by the given state
  *           instance
  *
- * \param[out] s      The global state object to update.
- * \param[out] value  A JSON value, hopefully containing Topologic metadata.
+ * \param[out] s The state object instance to modify.
+ * \param[in]  t The matrix cells to set.
  *
- * \returns 'true' if the code didn't blow up trying to parse your XML,
- *          'false' if it did. Probably.
+ * \returns 'true' if a transformation was updated, 'false' if not.
  */
 template <typename Q, std::size_t d>
-static bool parse(state<Q, d> &s, efgy::json::value<> &value) {
-  if (value.type != efgy::json::value<>::object) {
-    return false;
+static bool setTransformation(state<Q, d> &s, const std::vector<double> &t) {
+  if (t.size() != ((d + 1) * (d + 1))) {
+    return setTransformation<Q, d - 1>(s, t);
   }
 
-  bool polar = (bool)value("polar");
+  for (std::size_t i = 0; i <= d; i++) {
+    for (std::size_t j = 0; j <= d; j++) {
+      if (!std::isnan(t[(i * (d + 1) + j)])) {
+        s.transformation.matrix[i][j] = Q(t[(i * (d + 1) + j)]);
+      }
+    }
+  }
+
+  return true;
+}
+
+/**\brief Set transformation from JSON matrix cells; 1D fix point
+ *
+ * The 1D transformation matrix of the state object isn't being used, so
+ * this doesn't do anything.
+ *
+ * \tparam Q Base data type for calculations.
+ * \tparam d Maximum number of dimensions supported by the given state
+ *           instance
+ *
+ * \returns 'false', as no transformation was updated.
+ */
+template <typename Q, std::size_t d>
+static bool setTransformation(state<Q, 1> &, const std::vector<double> &) {
+  return false;
+}
 
-  if (value("camera").isArray()) {
-    efgy::json::value<> &cameras = value("camera");
-    for (efgy::json::value<> &c : cameras.toArray()) {
-      if (c.isArray() && c.size() == d) {
-        for (std::size_t i = 0; i < d; i++) {
-          if (c[i].type == efgy::json::value<>::number) {
-            if (polar) {
-              s.fromp[i] = c[i];
-            } else {
-              s.from[i] = c[i];
+/**\brief Topologic settings in JSON data
+ *
+ * Holds the settings read from JSON data, e.g. a file written by the JSON
+ * renderer, without applying them to a state object. The data is read
+ * directly with a topologic::jsonReader, in a single pass, instead of
+ * building a tree of JSON values and then looking up each setting in it;
+ * settings can also be read from such a tree, if there already is one.
+ *
+ * Settings that appear more than once are recorded as they appeared last,
+ * except for cameras and transformation matrices, which are recorded in
+ * the order they appeared in.
+ */
+class jsonSettings {
+public:
+  /**\brief Read JSON data
+   *
+   * Reads the settings in the given JSON data. The data is checked to be a
+   * valid JSON object first; if it isn't, no settings are recorded.
+   *
+   * \param[in] data JSON data, hopefully containing Topologic metadata.
+   * \param[in] size Length of the JSON data, in bytes.
+   */
+  jsonSettings(const char *data, std::size_t size)
+      : valid(false), polar(false), hasPolar(false) {
+    jsonReader check(data, size);
+    if (!check.peek('{') || !check.skip() || !check.done()) {
+      return;
+    }
+
+    jsonReader r(data, size);
+    std::string key, text;
+    std::vector<double> v;
+    double n;
+
+    r.next('{');
+    if (!r.next('}')) {
+      do {
+        r.string(key);
+        r.next(':');
+
+        switch (kind(key)) {
+        case polarFlag:
+          polar = r.next("true");
+          if (!polar) {
+            r.skip();
+          }
+          hasPolar = true;
+          break;
+        case list:
+          if (!r.next('[')) {
+            r.skip();
+            continue;
+          }
+          if (!r.next(']')) {
+            do {
+              if (!r.numbers(v)) {
+                r.skip();
+              } else {
+                (key == "camera" ? cameras : transformations).push_back(v);
+              }
+            } while (r.next(','));
+            r.next(']');
+          }
+          break;
+        case colour:
+          if (!r.numbers(v)) {
+            r.skip();
+          } else if (isColour(v)) {
+            colours[key] = v;
+          }
+          break;
+        case flag:
+          if (!r.next("null")) {
+            const bool b = r.next("true");
+            if (!b) {
+              r.skip();
             }
+            flags[key] = b;
+          }
+          break;
+        case name:
+          if (!r.string(text)) {
+            r.skip();
+          } else {
+            names[key] = text;
+          }
+          break;
+        case number:
+          if (!r.number(n)) {
+            r.skip();
+          } else {
+            numbers[key] = n;
           }
+          break;
+        case unknown:
+          r.skip();
         }
-      }
+      } while (r.next(','));
     }
+
+    valid = true;
   }
 
-  if (value("transformation").isArray()) {
-    efgy::json::value<> &transformations = value("transformation");
-    for (efgy::json::value<> &t : transformations.toArray()) {
-      if (t.isArray() && t.size() == ((d + 1) * (d + 1))) {
-        for (std::size_t i = 0; i <= d; i++) {
-          for (std::size_t j = 0; j <= d; j++) {
-            if (t[(i * (d + 1) + j)].isNumber()) {
-              s.transformation.matrix[i][j] =
-                  t[(i * (d + 1) + j)];
+  /**\brief Read JSON value
+   *
+   * Reads the settings in a JSON value that has already been parsed, e.g.
+   * by the desktop frontends. The same keys are recognised as when reading
+   * JSON data; the value needs to be an object, otherwise no settings are
+   * recorded.
+   *
+   * \param[in] value A JSON value, hopefully containing Topologic metadata.
+   */
+  jsonSettings(efgy::json::value<> &value)
+      : valid(false), polar(false), hasPolar(false) {
+    if (value.type != efgy::json::value<>::object) {
+      return;
+    }
+
+    for (const auto &k : keys()) {
+      efgy::json::value<> &v = value(k.first);
+
+      switch (k.second) {
+      case polarFlag:
+        polar = (bool)v;
+        hasPolar = (v.type != efgy::json::value<>::null);
+        break;
+      case list:
+        if (v.isArray()) {
+          for (efgy::json::value<> &e : v.toArray()) {
+            if (e.isArray()) {
+              (k.first == "camera" ? cameras : transformations)
+                  .push_back(toNumbers(e));
             }
           }
         }
+        break;
+      case colour:
+        if (v.isArray() && isColour(toNumbers(v))) {
+          colours[k.first] = toNumbers(v);
+        }
+        break;
+      case flag:
+        if (v.type != efgy::json::value<>::null) {
+          flags[k.first] = (bool)v;
+        }
+        break;
+      case name:
+        if (v.isString()) {
+          names[k.first] = v.asString();
+        }
+        break;
+      case number:
+        if (v.isNumber()) {
+          numbers[k.first] = double(v.asNumber());
+        }
+        break;
+      case unknown:
+        break;
       }
     }
+
+    valid = true;
   }
 
-  return parse<Q, d - 1>(s, value);
-}
+  /**\brief Was the data valid?
+   *
+   * 'true' if the data was a valid JSON object, 'false' otherwise.
+   */
+  bool valid;
+
+  /**\brief Polar cameras?
+   *
+   * Whether the cameras are given in polar coordinates.
+   */
+  bool polar;
+
+  /**\brief Polar setting given?
+   *
+   * Whether the data had a "polar" setting at all; if not, 'polar' is just
+   * the default, 'false'.
+   */
+  bool hasPolar;
 
-/**\brief Parse JSON file contents and update global state object; 1D fix
- *        point.
+  /**\brief Cameras
+   *
+   * The coordinates of the cameras, in the order they appeared in.
+   */
+  std::vector<std::vector<double>> cameras;
+
+  /**\brief Transformation matrices
+   *
+   * The cells of the transformation matrices, in the order they appeared
+   * in.
+   */
+  std::vector<std::vector<double>> transformations;
+
+  /**\brief Colours
+   *
+   * Maps "background", "wireframe" and "surface" to their colour's
+   * components, as written by the JSON renderer.
+   */
+  std::map<std::string, std::vector<double>> colours;
+
+  /**\brief Flags
+   *
+   * Maps "preRotate" and "postRotate" to their values.
+   */
+  std::map<std::string, bool> flags;
+
+  /**\brief Names
+   *
+   * Maps "model" and "coordinateFormat" to their values.
+   */
+  std::map<std::string, std::string> names;
+
+  /**\brief Numbers
+   *
+   * Maps the keys of all other settings with a numeric value to that value.
+   */
+  std::map<std::string, double> numbers;
+
+  /**\brief Get integer setting
+   *
+   * Looks up a setting with a numeric value that needs to be an integer,
+   * e.g. "seed". Values that aren't finite or don't fit in an int are
+   * ignored, as converting them to one would be undefined.
+   *
+   * \param[in]  key   The key of the setting.
+   * \param[out] value Set to the setting's value, if it has a usable one.
+   *
+   * \returns 'true' if the value was set, 'false' otherwise.
+   */
+  bool integer(const std::string &key, int &value) const {
+    const auto n = numbers.find(key);
+    if ((n == numbers.end()) || !(n->second >= INT_MIN) ||
+        !(n->second <= INT_MAX)) {
+      return false;
+    }
+    value = int(n->second);
+    return true;
+  }
+
+protected:
+  /**\brief Kinds of settings
+   *
+   * How the value of a setting is read and where it's recorded.
+   */
+  enum setting {
+    unknown,   ///< Not a setting; skipped.
+    polarFlag, ///< Whether cameras are polar; recorded in polar.
+    list,      ///< A list of cameras or transformation matrices.
+    colour,    ///< A colour; recorded in colours.
+    flag,      ///< A boolean; recorded in flags.
+    name,      ///< A string; recorded in names.
+    number     ///< A number; recorded in numbers.
+  };
+
+  /**\brief Known settings
+   *
+   * The keys of all the settings that are recognised, with their kinds.
+   * Both ways of reading settings use this table, so they can't disagree
+   * on which keys there are.
+   *
+   * \returns The keys of the settings, with their kinds.
+   */
+  static const std::map<std::string, setting> &keys(void) {
+    static const std::map<std::string, setting> table{
+        {"polar", polarFlag},
+        {"camera", list},
+        {"transformation", list},
+        {"background", colour},
+        {"wireframe", colour},
+        {"surface", colour},
+        {"preRotate", flag},
+        {"postRotate", flag},
+        {"model", name},
+        {"coordinateFormat", name},
+        {"depth", number},
+        {"renderDepth", number},
+        {"radius", number},
+        {"minorRadius", number},
+        {"constant", number},
+        {"precision", number},
+        {"iterations", number},
+        {"seed", number},
+        {"functions", number},
+        {"flameCoefficients", number}};
+    return table;
+  }
+
+  /**\brief Kind of setting
+   *
+   * \param[in] key The key of a setting.
+   *
+   * \returns The kind of the setting, or 'unknown' if there's no such
+   *          setting.
+   */
+  static setting kind(const std::string &key) {
+    const auto k = keys().find(key);
+    return k == keys().end() ? unknown : k->second;
+  }
+
+  /**\brief Is this a colour?
+   *
+   * Colours are written as the name of the colour space followed by the
+   * red, green, blue and alpha components.
+   *
+   * \param[in] v The elements of an array, as read by jsonReader::numbers().
+   *
+   * \returns 'true' if the components of a colour are all there.
+   */
+  static bool isColour(const std::vector<double> &v) {
+    return (v.size() >= 5) && !std::isnan(v[1]) && !std::isnan(v[2]) &&
+           !std::isnan(v[3]) && !std::isnan(v[4]);
+  }
+
+  /**\brief Convert JSON array
+   *
+   * Like jsonReader::numbers(), elements that aren't numbers show up as NaN.
+   *
+   * \param[in] value A JSON array.
+   *
+   * \returns The elements of the array.
+   */
+  static std::vector<double> toNumbers(efgy::json::value<> &value) {
+    std::vector<double> values;
+    for (efgy::json::value<> &e : value.toArray()) {
+      values.push_back(e.isNumber() ? double(e.asNumber()) : std::nan(""));
+    }
+    return values;
+  }
+};
+
+/**\brief Apply JSON settings to state object
  *
- * This is analogous to topologic::parse() with XML data; however, this
- * parses a JSON value instead of querying an XML parser.
+ * Updates a topologic::state instance with the settings read from JSON
+ * data. Like topologic::parse() with an XML metadata source, this does not
+ * update the model.
  *
  * \tparam Q Base data type for calculations.
  * \tparam d Maximum number of dimensions supported by the given state
  *           instance
  *
- * \param[out] s      The global state object to update.
- * \param[out] value  A JSON value, hopefully containing Topologic metadata.
+ * \param[out] s        The global state object to update.
+ * \param[in]  settings The settings to apply.
  *
- * \returns 'true' if the code didn't blow up trying to parse your XML,
- *          'false' if it did. Probably.
+ * \returns 'true' if the settings were valid, 'false' otherwise.
  */
 template <typename Q, std::size_t d>
-static bool parse(state<Q, 1> &s, efgy::json::value<> &value) {
-  if (value.type != efgy::json::value<>::object) {
+static bool parse(state<Q, d> &s, const jsonSettings &settings) {
+  if (!settings.valid) {
     return false;
   }
 
-  if (value("radius").isNumber()) {
-    s.parameter.radius = value("radius");
+  for (const auto &t : settings.transformations) {
+    setTransformation<Q, d>(s, t);
   }
-  if (value("minorRadius").isNumber()) {
-    s.parameter.radius2 = value("minorRadius");
+
+  for (const auto &c : settings.colours) {
+    auto &colour = c.first == "background"
+                       ? s.background
+                       : c.first == "wireframe" ? s.wireframe : s.surface;
+    colour.red = Q(c.second[1]);
+    colour.green = Q(c.second[2]);
+    colour.blue = Q(c.second[3]);
+    colour.alpha = Q(c.second[4]);
   }
-  if (value("constant").isNumber()) {
-    s.parameter.constant = value("constant");
+
+  for (const auto &f : settings.flags) {
+    (f.first == "preRotate" ? s.parameter.preRotate
+                            : s.parameter.postRotate) = f.second;
   }
-  if (value("precision").isNumber()) {
-    s.parameter.precision = value("precision");
+
+  for (const auto &n : settings.numbers) {
+    if (n.first == "radius") {
+      s.parameter.radius = Q(n.second);
+    } else if (n.first == "minorRadius") {
+      s.parameter.radius2 = Q(n.second);
+    } else if (n.first == "constant") {
+      s.parameter.constant = Q(n.second);
+    } else if (n.first == "precision") {
+      s.parameter.precision = Q(n.second);
+    }
   }
-  if (value("iterations").isNumber()) {
-    s.parameter.iterations = (int)value("iterations");
+
+  int n;
+  if (settings.integer("iterations", n)) {
+    s.parameter.iterations = n;
   }
-  if (value("seed").isNumber()) {
-    s.parameter.seed = (int)value("seed");
+  if (settings.integer("seed", n)) {
+    s.parameter.seed = n;
   }
-  if (value("functions").isNumber()) {
-    s.parameter.functions = (int)value("functions");
+  if (settings.integer("functions", n)) {
+    s.parameter.functions = n;
   }
-  if (value("flameCoefficients").isNumber()) {
-    s.parameter.flameCoefficients = (int)value("flameCoefficients");
+  if (settings.integer("flameCoefficients", n)) {
+    s.parameter.flameCoefficients = n;
   }
 
-  if (value("preRotate").type != efgy::json::value<>::null) {
-    s.parameter.preRotate = (bool)value("preRotate");
-  }
-  if (value("postRotate").type != efgy::json::value<>::null) {
-    s.parameter.postRotate = (bool)value("postRotate");
+  for (const auto &c : settings.cameras) {
+    setCamera<Q, d>(s, c, settings.polar);
   }
 
-  if (value("background").isArray() && value("background").size() >= 5 &&
-      value("background")[1].isNumber() && value("background")[2].isNumber() &&
-      value("background")[3].isNumber() && value("background")[4].isNumber()) {
-    s.background.red = value("background")[1];
-    s.background.green = value("background")[2];
-    s.background.blue = value("background")[3];
-    s.background.alpha = value("background")[4];
+  return true;
+}
+
+/**\brief Update model with JSON settings
+ *
+ * Like topologic::parseModel() with an XML metadata source, but with the
+ * settings read from JSON data. Settings that are missing default to a
+ * 4-cube with cartesian coordinates.
+ *
+ * \tparam Q    Base data type for calculations.
+ * \tparam d    Maximum number of dimensions supported by the given state
+ *              instance
+ * \tparam func State object update functor, e.g.
+ *              topologic::updateModel
+ *
+ * \param[out] s        The global state object to update.
+ * \param[in]  settings The settings to apply.
+ *
+ * \returns 'true' if things worked out, 'false' otherwise.
+ */
+template <typename Q, std::size_t d,
+          template <typename, template <class, std::size_t> class,
+                    std::size_t, std::size_t, typename> class func>
+static bool parseModel(state<Q, d> &s, const jsonSettings &settings) {
+  if (!settings.valid) {
+    return false;
   }
-  if (value("wireframe").isArray() && value("wireframe").size() >= 5 &&
-      value("wireframe")[1].isNumber() && value("wireframe")[2].isNumber() &&
-      value("wireframe")[3].isNumber() && value("wireframe")[4].isNumber()) {
-    s.wireframe.red = value("wireframe")[1];
-    s.wireframe.green = value("wireframe")[2];
-    s.wireframe.blue = value("wireframe")[3];
-    s.wireframe.alpha = value("wireframe")[4];
+
+  std::string type = "cube";
+  std::string format = "cartesian";
+  int depth = 4;
+  int rdepth = 4;
+
+  auto name = settings.names.find("model");
+  if (name != settings.names.end()) {
+    type = name->second;
   }
-  if (value("surface").isArray() && value("surface").size() >= 5 &&
-      value("surface")[1].isNumber() && value("surface")[2].isNumber() &&
-      value("surface")[3].isNumber() && value("surface")[4].isNumber()) {
-    s.surface.red = value("surface")[1];
-    s.surface.green = value("surface")[2];
-    s.surface.blue = value("surface")[3];
-    s.surface.alpha = value("surface")[4];
+  name = settings.names.find("coordinateFormat");
+  if (name != settings.names.end()) {
+    format = name->second;
   }
 
-  return true;
+  settings.integer("depth", depth);
+  settings.integer("renderDepth", rdepth);
+
+  return efgy::geometry::with<Q, func, d>(s, format, type, depth, rdepth);
+}
+
+/**\brief Parse JSON file contents and update global state object
+ *
+ * This is analogous to topologic::parse() with XML data; however, this
+ * parses a JSON value instead of querying an XML parser. The settings are
+ * read with topologic::jsonSettings, so they're the same as in JSON data
+ * read with topologic::parseJSON().
+ *
+ * \tparam Q Base data type for calculations.
+ * \tparam d Maximum number of dimensions supported by the given state
+ *           instance
+ *
+ * \param[out] s      The global state object to update.
+ * \param[out] value  A JSON value, hopefully containing Topologic metadata.
+ *
+ * \returns 'true' if the value was a JSON object, 'false' otherwise.
+ */
+template <typename Q, std::size_t d>
+static bool parse(state<Q, d> &s, efgy::json::value<> &value) {
+  return parse<Q, d>(s, jsonSettings(value));
 }
 
 /**\brief Parse and update model data
@@ -832,37 +2007,242 @@ template <typename Q, std::size_t d,
           template <typename, template <class, std::size_t> class,
                     std::size_t, std::size_t, typename> class func>
 static bool parseModel(state<Q, d> &s, efgy::json::value<> &value) {
-  if (value.type != efgy::json::value<>::object) {
+  return parseModel<Q, d, func>(s, jsonSettings(value));
+}
+
+/**\brief Parse JSON file contents and update global state object and model
+ *
+ * Does the same as topologic::parse() followed by topologic::parseModel()
+ * with a JSON value, but reads the JSON data with topologic::jsonSettings
+ * instead of building a tree of JSON values.
+ *
+ * The data is checked to be valid JSON before anything is applied, so
+ * broken files don't leave the state object half updated.
+ *
+ * \tparam Q    Base data type for calculations.
+ * \tparam d    Maximum number of dimensions supported by the given state
+ *              instance
+ * \tparam func State object update functor, e.g.
+ *              topologic::updateModel
+ *
+ * \param[out] s    The global state object to update.
+ * \param[in]  data JSON data, hopefully containing Topologic metadata.
+ * \param[in]  size Length of the JSON data, in bytes.
+ *
+ * \returns 'true' if things worked out, 'false' otherwise.
+ */
+template <typename Q, std::size_t d,
+          template <typename, template <class, std::size_t> class,
+                    std::size_t, std::size_t, typename> class func>
+static bool parseJSON(state<Q, d> &s, const char *data, std::size_t size) {
+  const jsonSettings settings(data, size);
+  return parse<Q, d>(s, settings) && parseModel<Q, d, func>(s, settings);
+}
+
+/**\brief Apply state patch
+ *
+ * Updates a live topologic::state instance with a patch: a JSON object with
+ * any of the keys that topologic::state::json() writes. Interactive clients
+ * can use this to send only the settings that changed, instead of all of
+ * the state. Settings that aren't in the patch are left alone.
+ *
+ * Cameras and transformation matrices are applied to the level that their
+ * number of coordinates or cells matches, so a patch only needs to have the
+ * levels that changed; e.g. {"transformation":[[...]]} with 16 cells only
+ * changes the 3D transformation matrix. If the patch sets "polar", the
+ * state object switches to polar or cartesian coordinates accordingly;
+ * either way, cameras are read in the coordinates the state object uses.
+ *
+ * The model is only created anew if the patch changes its type, depth,
+ * render depth or coordinate format; settings that aren't in the patch
+ * keep their current values. If the patch only changes parameters that
+ * the model's geometry depends on, the model is flagged for an update
+ * instead. Any other change is picked up when the next frame is drawn.
+ *
+ * \tparam Q    Base data type for calculations.
+ * \tparam d    Maximum number of dimensions supported by the given state
+ *              instance
+ * \tparam func State object update functor, e.g.
+ *              topologic::updateModel
+ *
+ * \param[out] s    The state object to update.
+ * \param[in]  data The patch, as JSON data.
+ * \param[in]  size Length of the JSON data, in bytes.
+ *
+ * \returns 'true' if the patch was valid and the state object has a
+ *          model, 'false' otherwise.
+ */
+template <typename Q, std::size_t d,
+          template <typename, template <class, std::size_t> class,
+                    std::size_t, std::size_t, typename> class func>
+static bool patch(state<Q, d> &s, const char *data, std::size_t size) {
+  jsonSettings settings(data, size);
+  if (!settings.valid) {
     return false;
+  } else if (settings.hasPolar) {
+    s.polarCoordinates = settings.polar;
+  } else {
+    settings.polar = s.polarCoordinates;
   }
 
-  std::string type = "cube";
-  std::string format = "cartesian";
-  int depth = 4;
-  int rdepth = 4;
+  const efgy::geometry::parameters<Q> before = s.parameter;
+  parse<Q, d>(s, settings);
 
-  auto &cformat = value("coordinateFormat");
-  if (cformat.isString()) {
-    format = cformat.asString();
+  std::string type, format;
+  int depth = 0, rdepth = 0;
+  if (s.model) {
+    type = s.model->id;
+    format = s.model->formatID;
+    depth = int(s.model->depth);
+    rdepth = int(s.model->renderDepth);
   }
 
-  auto &cmodel = value("model");
-  if (cmodel.isString()) {
-    type = cmodel.asString();
+  auto name = settings.names.find("model");
+  if (name != settings.names.end()) {
+    type = name->second;
+  }
+  name = settings.names.find("coordinateFormat");
+  if (name != settings.names.end()) {
+    format = name->second;
   }
 
-  auto &cdepth = value("depth");
-  if (cdepth.isNumber()) {
-    depth = cdepth.asNumber();
+  settings.integer("depth", depth);
+  settings.integer("renderDepth", rdepth);
+
+  if (!s.model || (type != s.model->id) || (format != s.model->formatID) ||
+      (depth != int(s.model->depth)) ||
+      (rdepth != int(s.model->renderDepth))) {
+    return efgy::geometry::with<Q, func, d>(s, format, type, depth, rdepth);
   }
 
-  auto &crdepth = value("renderDepth");
-  if (crdepth.isNumber()) {
-    rdepth = crdepth.asNumber();
+  const efgy::geometry::parameters<Q> &after = s.parameter;
+  if ((before.radius != after.radius) || (before.radius2 != after.radius2) ||
+      (before.constant != after.constant) ||
+      (before.precision != after.precision) ||
+      (before.iterations != after.iterations) ||
+      (before.seed != after.seed) || (before.functions != after.functions) ||
+      (before.flameCoefficients != after.flameCoefficients) ||
+      (before.preRotate != after.preRotate) ||
+      (before.postRotate != after.postRotate)) {
+    s.model->update = true;
   }
 
-  return efgy::geometry::with<Q, func, d>(s, format, type, depth, rdepth);
+  return true;
 }
+
+/**\brief Input document
+ *
+ * The settings read from an input file, either Topologic's metadata in an
+ * XML file or the settings in a JSON file, ready to be applied to a state
+ * object. Reading a file doesn't involve any state object, so several
+ * files can be read at the same time and applied afterwards, in order.
+ */
+class document {
+public:
+  /**\brief Read file
+   *
+   * Reads the given file as XML, if it is an XML file and XML support is
+   * available, or as JSON otherwise. The file is closed again once it has
+   * been read.
+   *
+   * \param[in] filename The name of the file to read.
+   */
+  document(const std::string &filename) : settings(0, 0) {
+    const input in(filename);
+
+#if !defined(NOLIBRARIES)
+    metadata.reset(new xml::reader(in.data(), in.size(), filename));
+    if (metadata->valid) {
+      return;
+    }
+    metadata.reset();
+#endif
+
+    settings = jsonSettings(in.data(), in.size());
+  }
+
+  /**\brief Apply to state object
+   *
+   * Updates the given state object and its model with the settings in the
+   * file, as topologic::parse() and topologic::parseModel() would.
+   *
+   * \tparam Q    Base data type for calculations.
+   * \tparam d    Maximum number of dimensions supported by the given state
+   *              instance
+   * \tparam func State object update functor, e.g.
+   *              topologic::updateModel
+   *
+   * \param[out] s The state object to update.
+   *
+   * \returns 'true' if things worked out, 'false' otherwise.
+   */
+  template <typename Q, std::size_t d,
+            template <typename, template <class, std::size_t> class,
+                      std::size_t, std::size_t, typename> class func>
+  bool apply(state<Q, d> &s) {
+#if !defined(NOLIBRARIES)
+    if (metadata) {
+      parse<Q, d>(s, *metadata);
+      return parseModel<Q, d, func>(s, *metadata);
+    }
+#endif
+
+    return parse<Q, d>(s, settings) && parseModel<Q, d, func>(s, settings);
+  }
+
+  /**\brief Read files
+   *
+   * Reads all of the given files, in parallel. Each of the files is read
+   * by whichever thread gets to it first, so the time this takes is bound
+   * by the largest file rather than the sum of all of them.
+   *
+   * \param[in] filenames The names of the files to read.
+   *
+   * \returns The files' documents, in the order the files were given in.
+   */
+  static std::vector<std::unique_ptr<document>>
+  load(const std::vector<std::string> &filenames) {
+    std::vector<std::unique_ptr<document>> documents(filenames.size());
+    std::atomic<std::size_t> next(0);
+
+    auto worker = [&filenames, &documents, &next]() {
+      for (std::size_t i = next++; i < filenames.size(); i = next++) {
+        documents[i].reset(new document(filenames[i]));
+      }
+    };
+
+    std::size_t n = std::thread::hardware_concurrency();
+    n = std::max<std::size_t>(1, std::min(n, filenames.size()));
+
+    std::vector<std::thread> pool;
+    for (std::size_t i = 1; i < n; i++) {
+      pool.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto &t : pool) {
+      t.join();
+    }
+
+    return documents;
+  }
+
+protected:
+#if !defined(NOLIBRARIES)
+  /**\brief XML metadata
+   *
+   * The metadata read from an XML file, or empty if the file was read as
+   * JSON.
+   */
+  std::unique_ptr<xml::reader> metadata;
+#endif
+
+  /**\brief JSON settings
+   *
+   * The settings read from a JSON file. Not valid if the file was read as
+   * XML.
+   */
+  jsonSettings settings;
+};
 }
 
 #endif
@@ -0,0 +1,1027 @@
+/**\file
+ * \brief Software rasteriser
+ *
+ * Renders projected 2D faces to a bitmap without any help from a GPU, so that
+ * pixel output can be produced on machines that have neither an OpenGL
+ * context nor an SVG rasteriser. The output looks like the SVG output: faces
+ * are filled with the surface colour and outlined with the wireframe colour,
+ * in the order they were generated.
+ *
+ * The image is split into square tiles. Faces are first sorted into the tiles
+ * they overlap, then the tiles are rasterised in parallel; since no two
+ * threads ever touch the same tile, no locking is needed while rasterising.
+ *
+ * Face coverage is determined with edge functions, which are evaluated for a
+ * whole run of pixels at a time - 16 at once with AVX-512, 8 with AVX2, or
+ * one by one otherwise. Which of these is used is decided at compile time,
+ * so build with e.g. -march=native to get the vectorised versions.
+ * Antialiasing uses 4x or 8x multisampling with the standard Direct3D sample
+ * patterns; every sample has its own colour, and the samples of a pixel are
+ * averaged once a tile is complete.
+ *
+ * With lighting enabled, the rasteriser draws what the OpenGL renderer would
+ * instead: every sample also has a depth, so faces hide whatever is behind
+ * them regardless of the order they were generated in, and faces are shaded
+ * according to how directly they face the camera.
+ *
+ * Translucent surfaces can optionally be blended with weighted blended order
+ * independent transparency, which needs no sorting and only a little extra
+ * memory per sample, so the result is the same regardless of the order that
+ * faces were generated in. Alternatively, faces can be sorted and drawn from
+ * back to front, which composites translucent faces exactly; the order can
+ * be kept from one frame of an animation to the next, where it only needs
+ * minor repairs.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_RASTER_H)
+#define TOPOLOGIC_RASTER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <thread>
+#include <vector>
+
+#if defined(__AVX2__) || defined(__AVX512F__)
+#include <immintrin.h>
+#endif
+
+#include <topologic/sink.h>
+
+namespace topologic {
+namespace render {
+/**\brief Tiled software rasteriser
+ *
+ * A face sink that collects 2D faces and rasterises them into an 8 bit RGBA
+ * bitmap once the model is complete. Coordinates are expected in the same
+ * space as the SVG output, i.e. the visible area is [-1.2, 1.2] on both axes,
+ * with y pointing down.
+ */
+class rasteriser : public sink {
+public:
+  /**\brief RGBA colour
+   *
+   * Colour components in the range [0, 1].
+   */
+  typedef std::array<float, 4> colour;
+
+  /**\brief Construct with image size and colours
+   *
+   * \param[in] pWidth      Width of the image, in pixels.
+   * \param[in] pHeight     Height of the image, in pixels.
+   * \param[in] pBackground Colour to clear the image with.
+   * \param[in] pWireframe  Colour to outline faces with.
+   * \param[in] pSurface    Colour to fill faces with.
+   * \param[in] pSamples    Samples per pixel; 1, 4 or 8. Other values are
+   *                        rounded down to one of these.
+   * \param[in] pLighting   Whether to depth test and shade faces.
+   * \param[in] pOrderIndependent Whether to blend translucent faces
+   *                              independently of their order.
+   * \param[in] pSorted     Whether to draw faces from back to front; see
+   *                        order.
+   * \param[in] pThreads    Number of threads to rasterise with; '0' means to
+   *                        use one thread per core.
+   */
+  rasteriser(std::size_t pWidth, std::size_t pHeight,
+             const colour &pBackground, const colour &pWireframe,
+             const colour &pSurface, std::size_t pSamples = 1,
+             bool pLighting = false, bool pOrderIndependent = false,
+             bool pSorted = false, std::size_t pThreads = 0)
+      : width(pWidth), height(pHeight), background(pBackground),
+        wireframe(pWireframe), surface(pSurface),
+        samples(pSamples >= 8 ? 8 : pSamples >= 4 ? 4 : 1),
+        lighting(pLighting), orderIndependent(pOrderIndependent),
+        sorted(pSorted && !pOrderIndependent), threads(pThreads),
+        faceVertices(0), nearest(0), farthest(0) {}
+
+  std::size_t dimension(void) const { return 2; }
+
+  bool begin(const std::string &, std::size_t pDimension,
+             std::size_t pFaceVertices) {
+    faceVertices = pFaceVertices;
+    vertices.clear();
+    depths.clear();
+    lights.clear();
+    return pDimension == 2 && width > 0 && height > 0;
+  }
+
+  bool shaded(void) const { return lighting || sorted; }
+
+  /**\copydoc sink::shading
+   *
+   * Stores the attributes until end() is called.
+   */
+  bool shading(const double *depth, const double *light, std::size_t count) {
+    for (std::size_t i = 0; i < count * faceVertices; i++) {
+      depths.push_back(float(depth[i]));
+    }
+    for (std::size_t i = 0; i < count; i++) {
+      lights.push_back(float(light[i]));
+    }
+    return true;
+  }
+
+  /**\copydoc sink::faces
+   *
+   * Converts the faces to pixel coordinates and stores them until end() is
+   * called.
+   */
+  bool faces(const double *coordinates, std::size_t count) {
+    const double sx = double(width) / 2.4, sy = double(height) / 2.4;
+    for (std::size_t i = 0; i < count * faceVertices; i++) {
+      vertices.push_back(float((coordinates[i * 2] + 1.2) * sx));
+      vertices.push_back(float((coordinates[i * 2 + 1] + 1.2) * sy));
+    }
+    return true;
+  }
+
+  /**\copydoc sink::end
+   *
+   * Rasterises all of the faces that were collected.
+   */
+  bool end(void) {
+    pixels.assign(width * height * 4, 0);
+
+    const std::size_t columns = (width + tileSize - 1) / tileSize;
+    const std::size_t rows = (height + tileSize - 1) / tileSize;
+    const std::size_t count =
+        faceVertices > 0 ? vertices.size() / 2 / faceVertices : 0;
+    const bool shade = lighting && lights.size() == count;
+
+    if (sorted && depths.size() == count * faceVertices) {
+      sort(count);
+    } else {
+      order.clear();
+    }
+
+    std::vector<std::vector<std::uint32_t>> bins(columns * rows);
+    for (std::size_t k = 0; k < count; k++) {
+      const std::size_t i = order.empty() ? k : order[k];
+      std::size_t x0, y0, x1, y1;
+      if (clip(i, 0, 0, width, height, x0, y0, x1, y1)) {
+        for (std::size_t y = y0 / tileSize; y <= (y1 - 1) / tileSize; y++) {
+          for (std::size_t x = x0 / tileSize; x <= (x1 - 1) / tileSize; x++) {
+            bins[y * columns + x].push_back(std::uint32_t(i));
+          }
+        }
+      }
+    }
+
+    nearest = farthest = 0;
+    if (shade && !depths.empty()) {
+      nearest = std::numeric_limits<float>::infinity();
+      farthest = -nearest;
+      for (const float d : depths) {
+        if (std::isfinite(d)) {
+          nearest = std::min(nearest, d);
+          farthest = std::max(farthest, d);
+        }
+      }
+    }
+
+    std::atomic<std::size_t> next(0);
+    auto worker = [&]() {
+      const std::size_t n = tileSize * tileSize * samples;
+      scratch memory;
+      memory.colour.resize(n * 4);
+      memory.depth.resize(shade ? n : 0);
+      memory.translucent.resize(orderIndependent ? n * 5 : 0);
+      memory.mask.resize(tileSize);
+      for (std::size_t t = next++; t < bins.size(); t = next++) {
+        tile(t % columns * tileSize, t / columns * tileSize, bins[t], memory);
+      }
+    };
+
+    std::size_t n = threads > 0 ? threads : std::thread::hardware_concurrency();
+    n = std::max<std::size_t>(1, std::min(n, bins.size()));
+
+    std::vector<std::thread> pool;
+    for (std::size_t i = 1; i < n; i++) {
+      pool.push_back(std::thread(worker));
+    }
+    worker();
+    for (auto &t : pool) {
+      t.join();
+    }
+
+    return true;
+  }
+
+  /**\brief Image width
+   *
+   * Width of the image, in pixels.
+   */
+  const std::size_t width;
+
+  /**\brief Image height
+   *
+   * Height of the image, in pixels.
+   */
+  const std::size_t height;
+
+  /**\brief Pixels
+   *
+   * RGBA values of the image's pixels, row by row, starting at the top left
+   * corner. Filled in by end().
+   */
+  std::vector<std::uint8_t> pixels;
+
+  /**\brief Drawing order
+   *
+   * Indices of the faces in the order they are drawn, from back to front, if
+   * faces are sorted. Set this to the order of the previous frame of an
+   * animation before rendering the next one, and end() will only repair the
+   * order instead of sorting from scratch.
+   */
+  std::vector<std::uint32_t> order;
+
+protected:
+  /**\brief Tile size
+   *
+   * Width and height of a tile, in pixels; small enough for a tile's sample
+   * buffer to stay in the L2 cache, even with 8x multisampling.
+   */
+  static const std::size_t tileSize = 32;
+
+  /**\brief Outline depth bias
+   *
+   * Relative amount by which an outline may be behind the depth buffer and
+   * still be drawn, so that faces that share an edge don't hide each other's
+   * outlines due to rounding errors.
+   */
+  static constexpr float depthBias = 1e-3f;
+
+  /**\brief Outline width
+   *
+   * The SVG output strokes paths 0.002 units wide; this converts that to
+   * pixels, but never goes below one pixel so the wireframe doesn't vanish in
+   * small thumbnails.
+   *
+   * \returns Half of the outline width, in pixels.
+   */
+  float strokeWidth(void) const {
+    return std::max(0.5f, float(std::max(width, height)) * 0.001f / 2.4f);
+  }
+
+  /**\brief Clip face bounding box
+   *
+   * Calculates the bounding box of a face, including its outline, and clips
+   * it to a rectangle.
+   *
+   * \param[in]  face Index of the face.
+   * \param[in]  left Left edge of the rectangle, in pixels.
+   * \param[in]  top  Top edge of the rectangle, in pixels.
+   * \param[in]  w    Width of the rectangle, in pixels.
+   * \param[in]  h    Height of the rectangle, in pixels.
+   * \param[out] x0   First column covered by the box, relative to 'left'.
+   * \param[out] y0   First row covered by the box, relative to 'top'.
+   * \param[out] x1   One past the last column covered by the box.
+   * \param[out] y1   One past the last row covered by the box.
+   *
+   * \returns 'false' if the face is entirely outside of the rectangle, or if
+   *          it has vertices that aren't finite.
+   */
+  bool clip(std::size_t face, std::size_t left, std::size_t top,
+            std::size_t w, std::size_t h, std::size_t &x0, std::size_t &y0,
+            std::size_t &x1, std::size_t &y1) const {
+    const float *v = &vertices[face * faceVertices * 2];
+    float box[4] = {v[0], v[1], v[0], v[1]};
+    for (std::size_t i = 1; i < faceVertices; i++) {
+      box[0] = std::min(box[0], v[i * 2]);
+      box[1] = std::min(box[1], v[i * 2 + 1]);
+      box[2] = std::max(box[2], v[i * 2]);
+      box[3] = std::max(box[3], v[i * 2 + 1]);
+    }
+
+    const float r = strokeWidth();
+    box[0] = box[0] - r - float(left);
+    box[1] = box[1] - r - float(top);
+    box[2] = box[2] + r - float(left) + 1.f;
+    box[3] = box[3] + r - float(top) + 1.f;
+
+    for (const float b : box) {
+      if (!std::isfinite(b)) {
+        return false;
+      }
+    }
+    if (box[2] <= 0 || box[3] <= 0 || box[0] >= float(w) ||
+        box[1] >= float(h)) {
+      return false;
+    }
+
+    x0 = std::size_t(std::max(box[0], 0.f));
+    y0 = std::size_t(std::max(box[1], 0.f));
+    x1 = std::size_t(std::min(box[2], float(w)));
+    y1 = std::size_t(std::min(box[3], float(h)));
+    return x0 < x1 && y0 < y1;
+  }
+
+  /**\brief Blend colour
+   *
+   * Composites a colour over a pixel in a tile buffer.
+   *
+   * \param[in,out] p The pixel to blend into.
+   * \param[in]     c The colour to blend over the pixel.
+   */
+  static void blend(float *p, const colour &c) {
+    const float a = c[3];
+    p[0] = p[0] * (1.f - a) + c[0] * a;
+    p[1] = p[1] * (1.f - a) + c[1] * a;
+    p[2] = p[2] * (1.f - a) + c[2] * a;
+    p[3] = p[3] * (1.f - a) + a;
+  }
+
+  /**\brief Moves per face
+   *
+   * Number of moves per face that sort() allows itself when repairing an
+   * existing order, before deciding that the order was too far off and
+   * sorting from scratch.
+   */
+  static const std::size_t repairMoves = 8;
+
+  /**\brief Sort faces back to front
+   *
+   * Sorts the faces by their average depth, farthest first. Consecutive
+   * frames of an animation usually only swap a few neighbouring faces, so
+   * if the current order has the right size it is repaired with an insertion
+   * sort, which is linear in the number of faces plus the number of moves it
+   * needs. If that takes too many moves, a regular merge sort is used
+   * instead.
+   *
+   * \param[in] count Number of faces.
+   */
+  void sort(std::size_t count) {
+    std::vector<float> key(count);
+    for (std::size_t i = 0; i < count; i++) {
+      float sum = 0;
+      for (std::size_t j = 0; j < faceVertices; j++) {
+        sum += depths[i * faceVertices + j];
+      }
+      // faces with vertices at infinity go all the way to the back.
+      key[i] = std::isfinite(sum) ? sum : std::numeric_limits<float>::max();
+    }
+
+    bool valid = order.size() == count;
+    for (std::size_t i = 0; valid && i < count; i++) {
+      valid = order[i] < count;
+    }
+    if (!valid) {
+      order.resize(count);
+      for (std::size_t i = 0; i < count; i++) {
+        order[i] = std::uint32_t(i);
+      }
+    }
+
+    std::size_t budget = count * repairMoves;
+    bool repaired = true;
+    for (std::size_t i = 1; repaired && i < count; i++) {
+      const std::uint32_t f = order[i];
+      std::size_t j = i;
+      for (; j > 0 && key[order[j - 1]] < key[f]; j--) {
+        if (budget-- == 0) {
+          repaired = false;
+          break;
+        }
+        order[j] = order[j - 1];
+      }
+      order[j] = f;
+    }
+
+    if (!repaired) {
+      std::stable_sort(order.begin(), order.end(),
+                       [&key](std::uint32_t a, std::uint32_t b) {
+        return key[a] > key[b];
+      });
+    }
+  }
+
+  /**\brief Depth plane
+   *
+   * Faces are planar, so their depth can be interpolated linearly across the
+   * screen from the depth of the first triangle of the face that has any
+   * area. This is exact for orthographic projections, but only an
+   * approximation for perspective projections like the ones Topologic uses,
+   * as depth isn't affine in screen space there. It does let the outlines
+   * be depth tested against the same plane as the face they belong to.
+   *
+   * \param[in]  face  Index of the face.
+   * \param[out] plane Depth at the face's first vertex, followed by the
+   *                   change of the depth per pixel along the x and y axes.
+   */
+  void depthPlane(std::size_t face, float plane[3]) const {
+    const float *v = &vertices[face * faceVertices * 2];
+    const float *z = &depths[face * faceVertices];
+    plane[0] = z[0];
+    plane[1] = 0;
+    plane[2] = 0;
+    for (std::size_t i = 2; i < faceVertices; i++) {
+      const float x1 = v[(i - 1) * 2] - v[0], y1 = v[(i - 1) * 2 + 1] - v[1];
+      const float x2 = v[i * 2] - v[0], y2 = v[i * 2 + 1] - v[1];
+      const float z1 = z[i - 1] - z[0], z2 = z[i] - z[0];
+      const float area = x1 * y2 - y1 * x2;
+      if (area != 0) {
+        plane[1] = (z1 * y2 - z2 * y1) / area;
+        plane[2] = (z2 * x1 - z1 * x2) / area;
+        return;
+      }
+    }
+  }
+
+  /**\brief Sample positions
+   *
+   * Offsets of the samples in a pixel, relative to the pixel's top left
+   * corner, as x/y pairs. These are the standard Direct3D patterns, which
+   * spread the samples out well on both axes.
+   *
+   * \returns A table with 'samples' pairs of offsets.
+   */
+  const float *pattern(void) const {
+    static const float one[] = {0.5f, 0.5f};
+    static const float four[] = {
+        0.375f, 0.125f, 0.875f, 0.375f, 0.125f, 0.625f, 0.625f, 0.875f};
+    static const float eight[] = {
+        0.5625f, 0.3125f, 0.4375f, 0.6875f, 0.8125f, 0.5625f, 0.3125f,
+        0.1875f, 0.1875f, 0.8125f, 0.0625f, 0.4375f, 0.6875f, 0.9375f,
+        0.9375f, 0.0625f};
+    return samples == 8 ? eight : samples == 4 ? four : one;
+  }
+
+  /**\brief Mark covered samples
+   *
+   * Evaluates three edge functions for a run of 'n' samples, one pixel apart,
+   * and sets 'bit' in the mask of every pixel where all three are
+   * non-negative.
+   *
+   * \param[in]     e    Values of the edge functions at the first sample.
+   * \param[in]     dx   Change of the edge functions from one pixel to the
+   *                     next.
+   * \param[in]     n    Number of pixels in the run.
+   * \param[in]     bit  Bit to set for covered samples.
+   * \param[in,out] mask Coverage masks of the pixels in the run.
+   */
+  static void coverage(const float e[3], const float dx[3], std::size_t n,
+                       std::uint8_t bit, std::uint8_t *mask) {
+    std::size_t i = 0;
+#if defined(__AVX512F__)
+    const __m512 lane = _mm512_set_ps(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4,
+                                      3, 2, 1, 0);
+    for (; i + 16 <= n; i += 16) {
+      const __m512 x = _mm512_add_ps(_mm512_set1_ps(float(i)), lane);
+      __m512 m = _mm512_add_ps(_mm512_set1_ps(e[0]),
+                               _mm512_mul_ps(_mm512_set1_ps(dx[0]), x));
+      for (std::size_t k = 1; k < 3; k++) {
+        m = _mm512_min_ps(m, _mm512_add_ps(_mm512_set1_ps(e[k]),
+                                           _mm512_mul_ps(
+                                               _mm512_set1_ps(dx[k]), x)));
+      }
+      const unsigned hit =
+          _mm512_cmp_ps_mask(m, _mm512_setzero_ps(), _CMP_GE_OQ);
+      for (std::size_t j = 0; hit && j < 16; j++) {
+        if (hit & (1u << j)) {
+          mask[i + j] |= bit;
+        }
+      }
+    }
+#elif defined(__AVX2__)
+    const __m256 lane = _mm256_set_ps(7, 6, 5, 4, 3, 2, 1, 0);
+    for (; i + 8 <= n; i += 8) {
+      const __m256 x = _mm256_add_ps(_mm256_set1_ps(float(i)), lane);
+      __m256 m = _mm256_add_ps(_mm256_set1_ps(e[0]),
+                               _mm256_mul_ps(_mm256_set1_ps(dx[0]), x));
+      for (std::size_t k = 1; k < 3; k++) {
+        m = _mm256_min_ps(m, _mm256_add_ps(_mm256_set1_ps(e[k]),
+                                           _mm256_mul_ps(
+                                               _mm256_set1_ps(dx[k]), x)));
+      }
+      const unsigned hit = unsigned(_mm256_movemask_ps(
+          _mm256_cmp_ps(m, _mm256_setzero_ps(), _CMP_GE_OQ)));
+      for (std::size_t j = 0; hit && j < 8; j++) {
+        if (hit & (1u << j)) {
+          mask[i + j] |= bit;
+        }
+      }
+    }
+#endif
+    for (; i < n; i++) {
+      const float x = float(i);
+      if (e[0] + dx[0] * x >= 0 && e[1] + dx[1] * x >= 0 &&
+          e[2] + dx[2] * x >= 0) {
+        mask[i] |= bit;
+      }
+    }
+  }
+
+  /**\brief Mark covered samples of a face
+   *
+   * Splits the face into a triangle fan and marks the samples covered by any
+   * of the triangles, for a run of pixels in one row. Either winding order is
+   * accepted.
+   *
+   * \param[in]     v    The face's vertices.
+   * \param[in]     x    Horizontal position of the first sample.
+   * \param[in]     y    Vertical position of the samples.
+   * \param[in]     n    Number of pixels in the run.
+   * \param[in]     bit  Bit to set for covered samples.
+   * \param[in,out] mask Coverage masks of the pixels in the run.
+   */
+  void span(const float *v, float x, float y, std::size_t n, std::uint8_t bit,
+            std::uint8_t *mask) const {
+    for (std::size_t i = 2; i < faceVertices; i++) {
+      const float *p[3] = {v, v + (i - 1) * 2, v + i * 2};
+      const float area = (p[1][0] - p[0][0]) * (p[2][1] - p[0][1]) -
+                         (p[1][1] - p[0][1]) * (p[2][0] - p[0][0]);
+      if (area == 0) {
+        continue;
+      }
+
+      const float sign = area > 0 ? 1.f : -1.f;
+      float e[3], dx[3];
+      for (std::size_t k = 0; k < 3; k++) {
+        const float *a = p[k], *b = p[(k + 1) % 3];
+        e[k] = sign * ((b[0] - a[0]) * (y - a[1]) - (b[1] - a[1]) * (x - a[0]));
+        dx[k] = -sign * (b[1] - a[1]);
+      }
+
+      coverage(e, dx, n, bit, mask);
+    }
+  }
+
+  /**\brief Is point on outline?
+   *
+   * \param[in] v The face's vertices.
+   * \param[in] x Horizontal position of the point.
+   * \param[in] y Vertical position of the point.
+   * \param[in] r Half of the outline width.
+   *
+   * \returns 'true' if the point is within 'r' of any of the face's edges.
+   */
+  bool outline(const float *v, float x, float y, float r) const {
+    for (std::size_t i = 0; i < faceVertices; i++) {
+      const float *a = v + i * 2, *b = v + ((i + 1) % faceVertices) * 2;
+      const float dx = b[0] - a[0], dy = b[1] - a[1];
+      const float l = dx * dx + dy * dy;
+      float t = l > 0 ? ((x - a[0]) * dx + (y - a[1]) * dy) / l : 0;
+      t = std::min(1.f, std::max(0.f, t));
+      const float ex = a[0] + t * dx - x, ey = a[1] + t * dy - y;
+      if (ex * ex + ey * ey <= r * r) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /**\brief Tile scratch memory
+   *
+   * Buffers that tile() works in. Every thread has its own set, which it
+   * reuses for all of the tiles it rasterises.
+   */
+  struct scratch {
+    /**\brief Sample colours
+     *
+     * RGBA colour of each of the tile's samples.
+     */
+    std::vector<float> colour;
+
+    /**\brief Sample depths
+     *
+     * Depth of the closest opaque surface at each of the tile's samples;
+     * empty unless lighting is enabled.
+     */
+    std::vector<float> depth;
+
+    /**\brief Translucent samples
+     *
+     * Weighted sum of the premultiplied translucent colours covering each of
+     * the tile's samples, and the sum of their weighted alpha values, followed
+     * by the product of their transparencies; empty unless order independent
+     * transparency is enabled.
+     */
+    std::vector<float> translucent;
+
+    /**\brief Coverage masks
+     *
+     * Coverage masks of the pixels in one row of the tile.
+     */
+    std::vector<std::uint8_t> mask;
+  };
+
+  /**\brief Visit covered samples
+   *
+   * Calls a function for every sample of a tile that a face covers.
+   *
+   * \tparam F Function type of the visitor.
+   *
+   * \param[in]     v     The face's vertices.
+   * \param[in]     x0    Left edge of the tile, in pixels.
+   * \param[in]     y0    Top edge of the tile, in pixels.
+   * \param[in]     box   Bounding box of the face in the tile, as returned by
+   *                      clip().
+   * \param[in,out] mask  Scratch buffer for a row's coverage masks.
+   * \param[in]     visit Called with the column and row in the tile and the
+   *                      sample number of each covered sample.
+   */
+  template <typename F>
+  void fillFace(const float *v, std::size_t x0, std::size_t y0,
+                const std::size_t box[4], std::vector<std::uint8_t> &mask,
+                const F &visit) const {
+    const float *offset = pattern();
+    for (std::size_t y = box[1]; y < box[3]; y++) {
+      std::fill(mask.begin(), mask.begin() + (box[2] - box[0]), 0);
+      for (std::size_t s = 0; s < samples; s++) {
+        span(v, float(x0 + box[0]) + offset[s * 2],
+             float(y0 + y) + offset[s * 2 + 1], box[2] - box[0],
+             std::uint8_t(1u << s), &mask[0]);
+      }
+      for (std::size_t x = box[0]; x < box[2]; x++) {
+        for (std::size_t s = 0; mask[x - box[0]] && s < samples; s++) {
+          if (mask[x - box[0]] & (1u << s)) {
+            visit(x, y, s);
+          }
+        }
+      }
+    }
+  }
+
+  /**\brief Visit outline samples
+   *
+   * Calls a function for every sample of a tile that a face's outline covers.
+   *
+   * \tparam F Function type of the visitor.
+   *
+   * \param[in] v     The face's vertices.
+   * \param[in] x0    Left edge of the tile, in pixels.
+   * \param[in] y0    Top edge of the tile, in pixels.
+   * \param[in] box   Bounding box of the face in the tile, as returned by
+   *                  clip().
+   * \param[in] visit Called with the column and row in the tile and the
+   *                  sample number of each covered sample.
+   */
+  template <typename F>
+  void strokeFace(const float *v, std::size_t x0, std::size_t y0,
+                  const std::size_t box[4], const F &visit) const {
+    const float r = strokeWidth();
+    const float *offset = pattern();
+    for (std::size_t y = box[1]; y < box[3]; y++) {
+      const float py = float(y0 + y);
+      for (std::size_t x = box[0]; x < box[2]; x++) {
+        const float px = float(x0 + x);
+        if (!outline(v, px + 0.5f, py + 0.5f, r + 0.75f)) {
+          continue;
+        }
+        for (std::size_t s = 0; s < samples; s++) {
+          if (outline(v, px + offset[s * 2], py + offset[s * 2 + 1], r)) {
+            visit(x, y, s);
+          }
+        }
+      }
+    }
+  }
+
+  /**\brief Translucency weight
+   *
+   * The depth weight of weighted blended order independent transparency, as
+   * proposed by McGuire and Bavoil: closer surfaces get a lot more weight
+   * than ones further back, so they dominate the blended colour the way they
+   * would with sorted compositing.
+   *
+   * \param[in] z Depth of the sample.
+   * \param[in] a Alpha value of the colour at the sample.
+   *
+   * \returns The weight of the colour at the sample.
+   */
+  float weight(float z, float a) const {
+    const float range = farthest - nearest;
+    const float d =
+        range > 0 ? std::min(1.f, std::max(0.f, (z - nearest) / range)) : 0;
+    return a * std::max(1e-2f, 3e3f * (1.f - d) * (1.f - d) * (1.f - d));
+  }
+
+  /**\brief Rasterise tile
+   *
+   * Draws all the faces that overlap a tile into a tile buffer, then averages
+   * each pixel's samples and copies the result to the image.
+   *
+   * Faces are normally drawn in the order they were generated, each filled
+   * and then outlined. With order independent transparency, opaque surfaces
+   * are filled first, then opaque outlines are drawn, and translucent
+   * surfaces and outlines are then blended on top with weighted blended
+   * order independent transparency, so the result doesn't depend on the
+   * order of the faces at all.
+   *
+   * If the depth buffer is not empty, faces are lit and depth tested: a face
+   * only covers samples where it is closer to the camera than any of the
+   * opaque faces drawn before it, and outlines only cover samples where they
+   * are no further away than that. Outlines and translucent surfaces don't
+   * update the depth buffer, so they don't hide the faces they belong to.
+   *
+   * \param[in]     x0     Left edge of the tile, in pixels.
+   * \param[in]     y0     Top edge of the tile, in pixels.
+   * \param[in]     faces  Indices of the faces that overlap the tile.
+   * \param[in,out] memory Scratch memory for the tile.
+   */
+  void tile(std::size_t x0, std::size_t y0,
+            const std::vector<std::uint32_t> &faces, scratch &memory) {
+    const std::size_t w = std::min(std::size_t(tileSize), width - x0);
+    const std::size_t h = std::min(std::size_t(tileSize), height - y0);
+    // like the SVG output, a fully transparent surface hides the outlines,
+    // too, so nothing but the background is drawn.
+    const bool fill = surface[3] > 0, stroke = fill && wireframe[3] > 0;
+    const bool shade = !memory.depth.empty();
+    const bool blended = !memory.translucent.empty();
+    const float *offset = pattern();
+
+    if (faces.empty()) {
+      std::uint8_t b[4];
+      for (std::size_t c = 0; c < 4; c++) {
+        b[c] = std::uint8_t(std::min(1.f, std::max(0.f, background[c])) *
+                                255.f +
+                            .5f);
+      }
+      for (std::size_t y = 0; y < h; y++) {
+        std::uint8_t *o = &pixels[((y0 + y) * width + x0) * 4];
+        for (std::size_t x = 0; x < w; x++) {
+          std::copy(b, b + 4, o + x * 4);
+        }
+      }
+      return;
+    }
+
+    float *buffer = memory.colour.data();
+    float *depth = memory.depth.data();
+    float *translucent = memory.translucent.data();
+    for (std::size_t i = 0; i < w * h * samples; i++) {
+      std::copy(background.begin(), background.end(), &buffer[i * 4]);
+    }
+    std::fill(memory.depth.begin(), memory.depth.end(),
+              std::numeric_limits<float>::infinity());
+    for (std::size_t i = 0; i < memory.translucent.size(); i += 5) {
+      std::fill(&translucent[i], &translucent[i + 4], 0.f);
+      translucent[i + 4] = 1;
+    }
+
+    // a face, prepared for drawing it into this tile.
+    struct {
+      const float *v;
+      std::size_t box[4];
+      colour c;
+      float plane[3];
+    } face;
+
+    const auto prepare = [&](std::uint32_t f)->bool {
+      face.v = &vertices[f * faceVertices * 2];
+      if (!clip(f, x0, y0, w, h, face.box[0], face.box[1], face.box[2],
+                face.box[3])) {
+        return false;
+      }
+
+      // half of the surface colour is ambient, the other half depends on the
+      // light, which is how the OpenGL renderer shades surfaces.
+      face.c = surface;
+      face.plane[0] = face.plane[1] = face.plane[2] = 0;
+      if (shade) {
+        const float l = 0.5f + 0.5f * lights[f];
+        face.c[0] *= l;
+        face.c[1] *= l;
+        face.c[2] *= l;
+        depthPlane(f, face.plane);
+      }
+      return true;
+    };
+
+    const auto sample = [&](std::size_t x, std::size_t y,
+                            std::size_t s)->std::size_t {
+      return (y * tileSize + x) * samples + s;
+    };
+
+    const auto z = [&](std::size_t x, std::size_t y, std::size_t s)->float {
+      const float px = float(x0 + x) + offset[s * 2];
+      const float py = float(y0 + y) + offset[s * 2 + 1];
+      return face.plane[0] + face.plane[1] * (px - face.v[0]) +
+             face.plane[2] * (py - face.v[1]);
+    };
+
+    const auto surfaceVisitor = [&](std::size_t x, std::size_t y,
+                                    std::size_t s) {
+      const std::size_t i = sample(x, y, s);
+      if (shade) {
+        const float d = z(x, y, s);
+        if (!(d < depth[i])) {
+          return;
+        }
+        if (face.c[3] >= 1) {
+          depth[i] = d;
+        }
+      }
+      blend(&buffer[i * 4], face.c);
+    };
+
+    const auto outlineVisitor = [&](std::size_t x, std::size_t y,
+                                    std::size_t s) {
+      const std::size_t i = sample(x, y, s);
+      if (shade && !(z(x, y, s) <= depth[i] * (1.f + depthBias))) {
+        return;
+      }
+      blend(&buffer[i * 4], wireframe);
+    };
+
+    if (!blended) {
+      for (const std::uint32_t f : faces) {
+        if (!prepare(f)) {
+          continue;
+        }
+        if (fill) {
+          fillFace(face.v, x0, y0, face.box, memory.mask, surfaceVisitor);
+        }
+        if (stroke) {
+          strokeFace(face.v, x0, y0, face.box, outlineVisitor);
+        }
+      }
+    } else {
+      const bool opaqueSurface = surface[3] >= 1;
+      const bool opaqueOutline = wireframe[3] >= 1;
+
+      if (fill && opaqueSurface) {
+        for (const std::uint32_t f : faces) {
+          if (prepare(f)) {
+            fillFace(face.v, x0, y0, face.box, memory.mask, surfaceVisitor);
+          }
+        }
+      }
+      if (stroke && opaqueOutline) {
+        for (const std::uint32_t f : faces) {
+          if (prepare(f)) {
+            strokeFace(face.v, x0, y0, face.box, outlineVisitor);
+          }
+        }
+      }
+
+      const auto accumulate = [&](std::size_t i, const colour &c, float d) {
+        float *t = &translucent[i * 5];
+        const float a = weight(d, c[3]);
+        t[0] += c[0] * a;
+        t[1] += c[1] * a;
+        t[2] += c[2] * a;
+        t[3] += a;
+        t[4] *= 1.f - c[3];
+      };
+
+      for (const std::uint32_t f : faces) {
+        if (!prepare(f)) {
+          continue;
+        }
+        if (fill && !opaqueSurface) {
+          fillFace(face.v, x0, y0, face.box, memory.mask,
+                   [&](std::size_t x, std::size_t y, std::size_t s) {
+            const std::size_t i = sample(x, y, s);
+            const float d = shade ? z(x, y, s) : 0;
+            if (!shade || d < depth[i]) {
+              accumulate(i, face.c, d);
+            }
+          });
+        }
+        if (stroke && !opaqueOutline) {
+          strokeFace(face.v, x0, y0, face.box,
+                     [&](std::size_t x, std::size_t y, std::size_t s) {
+            const std::size_t i = sample(x, y, s);
+            const float d = shade ? z(x, y, s) : 0;
+            if (!shade || d <= depth[i] * (1.f + depthBias)) {
+              accumulate(i, wireframe, d);
+            }
+          });
+        }
+      }
+
+      for (std::size_t y = 0; y < h; y++) {
+        for (std::size_t x = 0; x < w; x++) {
+          for (std::size_t s = 0; s < samples; s++) {
+            const std::size_t i = sample(x, y, s);
+            const float *t = &translucent[i * 5];
+            if (t[3] <= 0) {
+              continue;
+            }
+            float *p = &buffer[i * 4];
+            const float revealed = t[4];
+            p[0] = t[0] / t[3] * (1.f - revealed) + p[0] * revealed;
+            p[1] = t[1] / t[3] * (1.f - revealed) + p[1] * revealed;
+            p[2] = t[2] / t[3] * (1.f - revealed) + p[2] * revealed;
+            p[3] = (1.f - revealed) + p[3] * revealed;
+          }
+        }
+      }
+    }
+
+    const float scale = 1.f / float(samples);
+    for (std::size_t y = 0; y < h; y++) {
+      for (std::size_t x = 0; x < w; x++) {
+        const float *p = &buffer[(y * tileSize + x) * samples * 4];
+        std::uint8_t *o = &pixels[((y0 + y) * width + x0 + x) * 4];
+        for (std::size_t c = 0; c < 4; c++) {
+          float sum = 0;
+          for (std::size_t s = 0; s < samples; s++) {
+            sum += p[s * 4 + c];
+          }
+          o[c] = std::uint8_t(std::min(1.f, std::max(0.f, sum * scale)) *
+                                  255.f +
+                              .5f);
+        }
+      }
+    }
+  }
+
+  /**\brief Background colour
+   *
+   * The colour the image is cleared with.
+   */
+  const colour background;
+
+  /**\brief Wireframe colour
+   *
+   * The colour that faces are outlined with.
+   */
+  const colour wireframe;
+
+  /**\brief Surface colour
+   *
+   * The colour that faces are filled with.
+   */
+  const colour surface;
+
+  /**\brief Samples per pixel
+   *
+   * Number of coverage and colour samples to take for each pixel; 1, 4 or 8.
+   */
+  const std::size_t samples;
+
+  /**\brief Lighting
+   *
+   * Whether faces are depth tested and shaded.
+   */
+  const bool lighting;
+
+  /**\brief Order independent transparency
+   *
+   * Whether translucent surfaces and outlines are blended independently of
+   * the order of the faces.
+   */
+  const bool orderIndependent;
+
+  /**\brief Sorting
+   *
+   * Whether faces are drawn from back to front.
+   */
+  const bool sorted;
+
+  /**\brief Thread count
+   *
+   * Number of threads to rasterise with, or '0' for one per core.
+   */
+  const std::size_t threads;
+
+  /**\brief Vertices per face
+   *
+   * Set by begin().
+   */
+  std::size_t faceVertices;
+
+  /**\brief Collected vertices
+   *
+   * Pixel coordinates of the vertices of all the faces passed to faces().
+   */
+  std::vector<float> vertices;
+
+  /**\brief Collected depths
+   *
+   * Distance of each of the collected vertices from the camera, if lighting
+   * is enabled.
+   */
+  std::vector<float> depths;
+
+  /**\brief Collected light
+   *
+   * How directly each of the collected faces faces the camera, if lighting is
+   * enabled.
+   */
+  std::vector<float> lights;
+
+  /**\brief Depth range
+   *
+   * Smallest and largest depth of any of the collected vertices, which the
+   * translucency weights are relative to. Set by end().
+   */
+  float nearest, farthest;
+};
+}
+}
+
+#endif
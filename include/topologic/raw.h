@@ -0,0 +1,194 @@
+/**\file
+ * \brief Raw geometry streams
+ *
+ * Pipelines that post-process Topologic's geometry don't want to parse SVG
+ * paths or JSON; they want the model's vertices as plain numbers that can be
+ * memory-mapped. This file contains a writer for such a raw stream.
+ *
+ * A raw stream starts with a 32 byte header, followed by the faces of the
+ * model. All values are little endian:
+ *
+ * | Offset | Size | Content                                          |
+ * | ------ | ---- | ------------------------------------------------ |
+ * | 0      | 8    | Magic: "TPLGRAW" followed by a 0 byte             |
+ * | 8      | 4    | Format version; currently 1                       |
+ * | 12     | 4    | Dimension of the vertices                         |
+ * | 16     | 4    | Number of vertices per face                       |
+ * | 20     | 4    | Size of a coordinate in bytes: 4 or 8             |
+ * | 24     | 8    | Number of faces, or 2^64-1 if unknown             |
+ *
+ * Each face is a sequence of vertices, and each vertex is a sequence of
+ * float32 or float64 coordinates. The face count is only known once the
+ * stream is complete, so if the output is not seekable - e.g. a pipe - the
+ * count is left as 2^64-1 and readers should consume faces until they reach
+ * the end of the stream.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_RAW_H)
+#define TOPOLOGIC_RAW_H
+
+#include <vector>
+
+#include <topologic/binary.h>
+#include <topologic/sink.h>
+
+namespace topologic {
+namespace render {
+/**\brief Raw geometry stream writer
+ *
+ * Writes faces to an output stream as they are produced, buffering only a
+ * small number of coordinates at a time. Faces are requested in the model's
+ * render depth, before any projections.
+ *
+ * \tparam T Coordinate type to write; either float or double.
+ */
+template <typename T> class raw : public sink {
+public:
+  /**\brief Construct with output stream
+   *
+   * \param[out] pOutput The stream to write to.
+   */
+  raw(std::ostream &pOutput)
+      : output(pOutput), count(0), start(-1), open(false) {
+    buffer.reserve(chunk);
+  }
+
+  /**\brief Destructor
+   *
+   * Flushes any buffered coordinates.
+   */
+  ~raw(void) { end(); }
+
+  std::size_t dimension(void) const { return 0; }
+
+  /**\copydoc sink::begin
+   *
+   * Writes the stream header.
+   */
+  bool begin(const std::string &, std::size_t pDimension,
+             std::size_t faceVertices) {
+    start = output.tellp();
+    count = 0;
+    open = true;
+
+    output.write("TPLGRAW", 8);
+    binary::put(output, std::uint32_t(1));
+    binary::put(output, std::uint32_t(pDimension));
+    binary::put(output, std::uint32_t(faceVertices));
+    binary::put(output, std::uint32_t(sizeof(T)));
+    binary::put(output, std::uint64_t(-1));
+
+    coordinates = pDimension * faceVertices;
+
+    return bool(output);
+  }
+
+  /**\copydoc sink::faces
+   *
+   * Appends the faces to the stream.
+   */
+  bool faces(const double *pCoordinates, std::size_t pCount) {
+    for (std::size_t i = 0; i < pCount * coordinates; i++) {
+      buffer.push_back(T(pCoordinates[i]));
+    }
+    count += pCount;
+
+    if (buffer.size() >= chunk) {
+      flush();
+    }
+
+    return bool(output);
+  }
+
+  /**\copydoc sink::end
+   *
+   * Flushes any buffered coordinates and, if the output is seekable, fills
+   * in the number of faces in the header.
+   */
+  bool end(void) {
+    if (!open) {
+      return bool(output);
+    }
+    open = false;
+
+    flush();
+
+    if (start != std::streampos(-1)) {
+      const std::streampos stop = output.tellp();
+      if (output.seekp(start + std::streamoff(24))) {
+        binary::put(output, std::uint64_t(count));
+        output.seekp(stop);
+      } else {
+        output.clear();
+      }
+    }
+
+    return bool(output);
+  }
+
+protected:
+  /**\brief Write buffered coordinates
+   *
+   * Writes all the coordinates in the buffer to the output and clears the
+   * buffer.
+   */
+  void flush(void) {
+    binary::put(output, buffer);
+    buffer.clear();
+  }
+
+  /**\brief Buffer size
+   *
+   * Number of coordinates to collect before writing them to the output.
+   */
+  static const std::size_t chunk = 8192;
+
+  /**\brief Output stream
+   *
+   * The stream that the faces are written to.
+   */
+  std::ostream &output;
+
+  /**\brief Coordinate buffer
+   *
+   * Coordinates that have not been written to the output yet.
+   */
+  std::vector<T> buffer;
+
+  /**\brief Coordinates per face
+   *
+   * Set by begin().
+   */
+  std::size_t coordinates;
+
+  /**\brief Face count
+   *
+   * Number of faces that have been added to the stream so far.
+   */
+  std::size_t count;
+
+  /**\brief Header position
+   *
+   * Position of the header in the output, or -1 if the output is not
+   * seekable.
+   */
+  std::streampos start;
+
+  /**\brief Is the stream open?
+   *
+   * Set by begin() and cleared by end(), so the header is only patched once.
+   */
+  bool open;
+};
+}
+}
+
+#endif
@@ -23,6 +23,24 @@
 #include <ef.gy/render-opengl.h>
 #endif
 
+#include <topologic/flame.h>
+#include <topologic/geometry.h>
+#include <topologic/image.h>
+#include <topologic/keyframes.h>
+#include <topologic/mesh.h>
+#include <topologic/raster.h>
+#include <topologic/raw.h>
+#include <topologic/sink.h>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <type_traits>
+#include <vector>
+
 namespace topologic {
 /**\brief Cartesian dimension shorthands
  *
@@ -123,6 +141,243 @@ public:
   bool update;
 };
 
+/**\brief Projection to a lower dimension
+ *
+ * Applies the affine transformations and projections of a state object's
+ * individual dimensions to a vector, until the vector has been reduced to the
+ * target dimension. This is the same chain of transformations that libefgy's
+ * renderers apply, so the results match what those renderers would draw.
+ *
+ * The combined transformation matrices are calculated when the projector is
+ * constructed, so you should create a new projector whenever the state's
+ * matrices have been updated.
+ *
+ * \tparam Q Base data type for calculations
+ * \tparam d Source dimension
+ * \tparam e Target dimension
+ * \tparam p Whether the source dimension is higher than the target dimension;
+ *           this is used to terminate the recursion and should not be set
+ *           manually.
+ */
+template <typename Q, std::size_t d, std::size_t e, bool p = (d > e)>
+class projector {
+public:
+  /**\brief Construct with global state
+   *
+   * Combines the affine transformation and the projection for each of the
+   * dimensions between the source and the target dimension.
+   *
+   * \param[in] pState The global state object to get the matrices from.
+   */
+  projector(const state<Q, d> &pState)
+      : combined(pState.transformation * pState.projection), lower(pState) {}
+
+  /**\brief Project vector
+   *
+   * \param[in] v The vector to project.
+   *
+   * \returns The vector after projecting it to the target dimension.
+   */
+  efgy::math::vector<Q, e> operator()(const efgy::math::vector<Q, d> &v) const {
+    return lower(combined * v);
+  }
+
+  /**\brief Project face
+   *
+   * \param[in] face The face to project.
+   *
+   * \returns The face after projecting all of its vertices to the target
+   *          dimension.
+   */
+  template <std::size_t f>
+  std::array<efgy::math::vector<Q, e>, f>
+  operator()(const std::array<efgy::math::vector<Q, d>, f> &face) const {
+    std::array<efgy::math::vector<Q, e>, f> rv;
+    for (std::size_t i = 0; i < f; i++) {
+      rv[i] = (*this)(face[i]);
+    }
+    return rv;
+  }
+
+protected:
+  /**\brief Combined transformation
+   *
+   * The affine transformation of this dimension, followed by the projection
+   * of this dimension.
+   */
+  efgy::geometry::transformation::projective<Q, d> combined;
+
+  /**\brief Projector for the next lower dimension
+   *
+   * Takes care of the remaining dimensions.
+   */
+  projector<Q, d - 1, e> lower;
+};
+
+/**\brief Projection to a lower dimension; fix point
+ *
+ * Terminates the recursion of the projector template. Vectors that have
+ * already reached the target dimension are passed through as they are;
+ * vectors in lower dimensions than the target are padded with zeroes.
+ *
+ * \tparam Q Base data type for calculations
+ * \tparam d Source dimension
+ * \tparam e Target dimension
+ */
+template <typename Q, std::size_t d, std::size_t e>
+class projector<Q, d, e, false> {
+public:
+  projector(const state<Q, d> &) {}
+
+  efgy::math::vector<Q, e> operator()(const efgy::math::vector<Q, d> &v) const {
+    efgy::math::vector<Q, e> rv;
+    for (std::size_t i = 0; i < e; i++) {
+      rv[i] = i < d ? v[i] : Q(0);
+    }
+    return rv;
+  }
+
+  template <std::size_t f>
+  std::array<efgy::math::vector<Q, e>, f>
+  operator()(const std::array<efgy::math::vector<Q, d>, f> &face) const {
+    std::array<efgy::math::vector<Q, e>, f> rv;
+    for (std::size_t i = 0; i < f; i++) {
+      rv[i] = (*this)(face[i]);
+    }
+    return rv;
+  }
+};
+
+/**\brief Shading attributes
+ *
+ * Collects the vertices of faces in the 3D level, after its affine
+ * transformation but before its projection, and calculates the attributes
+ * that sink::shading() expects from them for a whole chunk of faces at once.
+ *
+ * This generic version is used for models that are rendered in fewer than 3
+ * dimensions, which have neither depth nor lighting; all of their faces are
+ * at the same depth and fully lit.
+ *
+ * \tparam Q Base data type for calculations
+ * \tparam d Dimension of the vertices that are passed in
+ * \tparam f Number of vertices per face
+ */
+template <typename Q, std::size_t d, std::size_t f> class shader {
+public:
+  shader(const state<Q, d> &) : count(0) {}
+
+  /**\brief Add face
+   *
+   * \param[in] face The face to add, before the 3D affine transformation.
+   */
+  void add(const std::array<efgy::math::vector<Q, d>, f> &) { count++; }
+
+  /**\brief Calculate shading attributes
+   *
+   * Calculates the attributes of all the faces that were added since the last
+   * call, then forgets about those faces.
+   *
+   * \param[out] depth Distance of each vertex from the camera.
+   * \param[out] light How directly each face faces the camera.
+   */
+  void calculate(std::vector<double> &depth, std::vector<double> &light) {
+    depth.assign(count * f, 0.);
+    light.assign(count, 1.);
+    count = 0;
+  }
+
+protected:
+  /**\brief Face count
+   *
+   * Number of faces added since the last call to calculate().
+   */
+  std::size_t count;
+};
+
+/**\brief Shading attributes in 3D
+ *
+ * Faces are lit with a headlight, i.e. by a light at the camera's position,
+ * so the light only depends on the angle between a face's normal and the
+ * direction to the camera. The vertices are kept as one array per coordinate
+ * and vertex index, so the calculations run across faces with unit stride
+ * and can be vectorised by the compiler.
+ *
+ * \tparam Q Base data type for calculations
+ * \tparam f Number of vertices per face
+ */
+template <typename Q, std::size_t f> class shader<Q, 3, f> {
+public:
+  shader(const state<Q, 3> &pState)
+      : transformation(pState.transformation), from(pState.from) {}
+
+  void add(const std::array<efgy::math::vector<Q, 3>, f> &face) {
+    for (std::size_t v = 0; v < f; v++) {
+      const efgy::math::vector<Q, 3> p = transformation * face[v];
+      for (std::size_t k = 0; k < 3; k++) {
+        points[v * 3 + k].push_back(double(p[k] - from[k]));
+      }
+    }
+  }
+
+  void calculate(std::vector<double> &depth, std::vector<double> &light) {
+    const std::size_t count = points[0].size();
+    depth.resize(count * f);
+    light.resize(count);
+
+    for (std::size_t v = 0; v < f; v++) {
+      const double *x = points[v * 3].data(), *y = points[v * 3 + 1].data(),
+                   *z = points[v * 3 + 2].data();
+      for (std::size_t i = 0; i < count; i++) {
+        depth[i * f + v] = std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]);
+      }
+    }
+
+    // the normal of the first triangle of the face; faces are planar, so any
+    // other one would do just as well.
+    const std::size_t b = 1 % f, c = 2 % f;
+    const double *ax = points[0].data(), *ay = points[1].data(),
+                 *az = points[2].data(), *bx = points[b * 3].data(),
+                 *by = points[b * 3 + 1].data(), *bz = points[b * 3 + 2].data(),
+                 *cx = points[c * 3].data(), *cy = points[c * 3 + 1].data(),
+                 *cz = points[c * 3 + 2].data();
+    for (std::size_t i = 0; i < count; i++) {
+      const double ux = bx[i] - ax[i], uy = by[i] - ay[i], uz = bz[i] - az[i];
+      const double vx = cx[i] - ax[i], vy = cy[i] - ay[i], vz = cz[i] - az[i];
+      const double nx = uy * vz - uz * vy, ny = uz * vx - ux * vz,
+                   nz = ux * vy - uy * vx;
+      const double l = (nx * nx + ny * ny + nz * nz) *
+                       (ax[i] * ax[i] + ay[i] * ay[i] + az[i] * az[i]);
+      const double dot = nx * ax[i] + ny * ay[i] + nz * az[i];
+      light[i] = l > 0 ? std::abs(dot) / std::sqrt(l) : 1.;
+    }
+
+    for (auto &p : points) {
+      p.clear();
+    }
+  }
+
+protected:
+  /**\brief 3D affine transformation
+   *
+   * Copied from the state object when the shader is constructed.
+   */
+  const efgy::geometry::transformation::affine<Q, 3> transformation;
+
+  /**\brief Camera position
+   *
+   * The 3D 'from' point, copied from the state object when the shader is
+   * constructed.
+   */
+  const efgy::math::vector<Q, 3> from;
+
+  /**\brief Collected vertices
+   *
+   * Coordinates relative to the camera, one array for each coordinate of each
+   * of a face's vertices.
+   */
+  std::array<std::vector<double>, f * 3> points;
+};
+
 /**\brief Base class for a model renderer
  *
  * The primary purpose of this class is to force certain parts of a model
@@ -154,6 +409,102 @@ public:
    */
   virtual bool svg(std::ostream &output, bool updateMatrix = false) = 0;
 
+  /**\brief Render to animated SVG
+   *
+   * Renders one frame for each of the state's animation frames, moving the
+   * camera as set in the state's motion in between, and writes them all as a
+   * single SVG with the same header as the plain SVG output. Each face's path
+   * is written once and animated with SMIL, which is a lot smaller than one
+   * SVG per frame.
+   *
+   * \param[in] output The stream to write to.
+   *
+   * \returns 'true' upon success.
+   */
+  virtual bool smil(std::ostream &output) = 0;
+
+  /**\brief Render to face sinks
+   *
+   * Generates the model's faces once, projects them to each of the
+   * dimensions that the sinks ask for and passes them on in chunks. All the
+   * sinks share the same generation and projection pass, so e.g. a mesh and
+   * a raw stream can be written for the price of one.
+   *
+   * \param[in] sinks        The sinks to pass the faces to.
+   * \param[in] updateMatrix Whether to update the projection
+   *                         matrices.
+   *
+   * \returns 'true' upon success; 'false' if any of the sinks asked for an
+   *          unsupported dimension or reported an error.
+   */
+  virtual bool render(const std::vector<sink *> &sinks,
+                      bool updateMatrix = false) = 0;
+
+  /**\brief Render to binary glTF
+   *
+   * Projects the model to 3D and writes it as a binary glTF (GLB) file with
+   * packed float32 vertex positions and uint32 triangle indices. The
+   * serialised state object is embedded in the file's 'extras'.
+   *
+   * \param[in] output       The stream to write to.
+   * \param[in] updateMatrix Whether to update the projection
+   *                         matrices.
+   *
+   * \returns 'true' upon success.
+   */
+  virtual bool glb(std::ostream &output, bool updateMatrix = false) = 0;
+
+  /**\brief Write raw geometry stream
+   *
+   * Writes the model's faces as they are generated, in the model's render
+   * depth and before any projections, as a stream of float32 or float64
+   * coordinates - whichever matches the base data type. See raw.h for the
+   * layout of the stream.
+   *
+   * \param[in] output The stream to write to.
+   *
+   * \returns 'true' upon success.
+   */
+  virtual bool raw(std::ostream &output) = 0;
+
+  /**\brief Render to JSON with geometry
+   *
+   * Writes the same JSON metadata as the plain JSON output, with an
+   * additional "geometry" member that contains the model's faces as a flat
+   * array of coordinates. The faces are written as they are generated,
+   * without building a JSON value tree for them first.
+   *
+   * \param[in] output       The stream to write to.
+   * \param[in] project      Whether to project the faces to 3D; if 'false'
+   *                         then the faces are written in the model's render
+   *                         depth instead.
+   * \param[in] updateMatrix Whether to update the projection
+   *                         matrices.
+   *
+   * \returns 'true' upon success.
+   */
+  virtual bool json(std::ostream &output, bool project = true,
+                    bool updateMatrix = false) = 0;
+
+  /**\brief Render to bitmap
+   *
+   * Rasterises the model in software at the state's width and height, with
+   * the state's multisampling setting, and writes the result as a PNG, PPM
+   * or raw RGBA image. If fractal flame colouring is enabled, the model is
+   * rendered with the CPU flame renderer instead. Neither needs an OpenGL
+   * context, so this works on headless machines.
+   *
+   * \param[in] output       The stream to write to.
+   * \param[in] type         The format to write the image in.
+   * \param[in] updateMatrix Whether to update the projection
+   *                         matrices.
+   *
+   * \returns 'true' upon success.
+   */
+  virtual bool raster(std::ostream &output,
+                      enum image::format type = image::formatPNG,
+                      bool updateMatrix = false) = 0;
+
 #if !defined(NO_OPENGL)
   /**\brief Render to OpenGL context
    *
@@ -213,9 +564,7 @@ public:
              modelType::format::id()) {}
 
   bool svg(std::ostream &output, bool updateMatrix = false) {
-    if (metadata::update) {
-      metadata::update = false;
-    }
+    header();
 
     if (updateMatrix) {
       gState.width = 3;
@@ -225,33 +574,9 @@ public:
 
     gState.svg.frameStart();
 
-    output << "<?xml version='1.0' encoding='utf-8'?>"
-              "<svg xmlns='http://www.w3.org/2000/svg'"
-              " xmlns:xlink='http://www.w3.org/1999/xlink'"
-              " version='1.1' width='100%' height='100%' viewBox='-1.2 -1.2 "
-              "2.4 2.4'>"
-              "<title>" +
-                  metadata::name() +
-                  "</title>"
-                  "<metadata xmlns:t='http://ef.gy/2012/topologic'>"
-           << efgy::xml::tag() << gState;
-    output << "</metadata>"
-              "<style type='text/css'>svg { background: rgba("
-           << double(gState.background.red) * 100. << "%,"
-           << double(gState.background.green) * 100. << "%,"
-           << double(gState.background.blue) * 100. << "%,"
-           << double(gState.background.alpha)
-           << "); }"
-              " path { stroke-width: 0.002; stroke: rgba("
-           << double(gState.wireframe.red) * 100. << "%,"
-           << double(gState.wireframe.green) * 100. << "%,"
-           << double(gState.wireframe.blue) * 100. << "%,"
-           << double(gState.wireframe.alpha) << ");"
-                                                " fill: rgba("
-           << double(gState.surface.red) * 100. << "%,"
-           << double(gState.surface.green) * 100. << "%,"
-           << double(gState.surface.blue) * 100. << "%,"
-           << double(gState.surface.alpha) << "); }</style>";
+    output << prologue;
+    gState.cameraMetadata(output);
+    output << epilogue;
     if (gState.surface.alpha > Q(0.)) {
       output << gState.svg << object;
     }
@@ -262,6 +587,217 @@ public:
     return true;
   }
 
+  bool smil(std::ostream &output) {
+    header();
+
+    const std::size_t frames = std::max<std::size_t>(1, gState.frames);
+    keyframes k;
+    for (std::size_t i = 0; i < frames; i++) {
+      if (i > 0) {
+        gState.advance();
+      }
+      gState.width = 3;
+      gState.height = 3;
+      if (!render({&k}, true)) {
+        return false;
+      }
+      if (i == 0) {
+        output << prologue;
+        gState.cameraMetadata(output);
+        output << epilogue;
+      }
+    }
+
+    if (gState.surface.alpha > Q(0.)) {
+      k.write(output, double(frames) / double(framesPerSecond));
+    }
+    output << "</svg>\n";
+
+    return bool(output);
+  }
+
+  bool render(const std::vector<sink *> &sinks, bool updateMatrix = false) {
+    static const std::size_t f = modelType::faceVertices;
+    static const std::size_t n = modelType::renderDepth;
+    static const std::size_t m = n > 3 ? 3 : n;
+    static const std::size_t dimensions[3] = {n, 3, 2};
+
+    if (updateMatrix) {
+      gState.updateMatrix();
+    }
+
+    std::vector<std::size_t> slot;
+    bool want[3] = {false, false, false};
+    bool shade = false;
+    for (const sink *s : sinks) {
+      switch (s->dimension()) {
+      case 0:
+        slot.push_back(0);
+        break;
+      case 3:
+        slot.push_back(1);
+        break;
+      case 2:
+        slot.push_back(2);
+        break;
+      default:
+        return false;
+      }
+      want[slot.back()] = true;
+      shade = shade || (slot.back() == 2 && s->shaded());
+    }
+
+    bool rv = true;
+    for (std::size_t i = 0; i < sinks.size(); i++) {
+      rv = sinks[i]->begin(metadata::name(), dimensions[slot[i]], f) && rv;
+    }
+
+    const projector<Q, n, m> lower(gState);
+    const projector<Q, m, 3> to3(gState);
+    const projector<Q, m, 2> to2(gState);
+    shader<Q, m, f> attributes(gState);
+
+    std::vector<double> buffer[3], depth, light;
+    for (std::size_t i = 0; i < 3; i++) {
+      if (want[i]) {
+        buffer[i].reserve(chunk * f * dimensions[i]);
+      }
+    }
+
+    std::size_t count = 0;
+    for (const auto &face : object) {
+      if (!rv) {
+        break;
+      }
+
+      if (want[0]) {
+        append(buffer[0], face);
+      }
+      if (want[1] || want[2]) {
+        const auto l = lower(face);
+        if (want[1]) {
+          append(buffer[1], to3(l));
+        }
+        if (want[2]) {
+          append(buffer[2], to2(l));
+        }
+        if (shade) {
+          attributes.add(l);
+        }
+      }
+
+      if (++count == chunk) {
+        if (shade) {
+          attributes.calculate(depth, light);
+        }
+        rv = flush(sinks, slot, buffer, depth, light, count);
+        count = 0;
+      }
+    }
+
+    if (rv && count > 0) {
+      if (shade) {
+        attributes.calculate(depth, light);
+      }
+      rv = flush(sinks, slot, buffer, depth, light, count);
+    }
+
+    for (sink *s : sinks) {
+      rv = s->end() && rv;
+    }
+
+    return rv;
+  }
+
+  bool glb(std::ostream &output, bool updateMatrix = false) {
+    mesh m;
+
+    if (!render({&m}, updateMatrix)) {
+      return false;
+    }
+
+    std::ostringstream extras("");
+    extras << efgy::json::tag() << gState;
+
+    return m.glb(output, metadata::name(), extras.str());
+  }
+
+  bool raw(std::ostream &output) {
+    using scalar = typename std::conditional<sizeof(Q) <= sizeof(float),
+                                             float, double>::type;
+
+    render::raw<scalar> stream(output);
+
+    return render({&stream});
+  }
+
+  bool json(std::ostream &output, bool project = true,
+            bool updateMatrix = false) {
+    std::ostringstream header("");
+    header << efgy::json::tag() << gState;
+    std::string prefix = header.str();
+    if (prefix.size() < 2 || prefix[prefix.size() - 1] != '}') {
+      return false;
+    }
+    prefix[prefix.size() - 1] = ',';
+    output << prefix;
+
+    geometry g(output, project,
+               project ? std::numeric_limits<float>::max_digits10
+                       : std::numeric_limits<Q>::max_digits10);
+    const bool rv = render({&g}, updateMatrix);
+
+    output << "}";
+
+    return rv && bool(output);
+  }
+
+  bool raster(std::ostream &output, enum image::format type = image::formatPNG,
+              bool updateMatrix = false) {
+    const auto colour = [](const efgy::math::vector<
+        Q, 4, efgy::math::format::RGB> &c)->rasteriser::colour {
+      return {{float(c.red), float(c.green), float(c.blue), float(c.alpha)}};
+    };
+
+    const std::size_t width = std::size_t(gState.width);
+    const std::size_t height = std::size_t(gState.height);
+
+    if (gState.fractalFlameColouring) {
+      std::vector<flame::colour> palette;
+      for (const auto &c : gState.parameter.colourMap) {
+        palette.push_back(colour(c));
+      }
+
+      flame f(width, height, colour(gState.background), palette,
+              (unsigned long)(gState.parameter.seed));
+
+      if (!render({&f}, updateMatrix)) {
+        return false;
+      }
+
+      if (!progressive(f)) {
+        return false;
+      }
+      f.tonemap();
+
+      return image::write(output, type, f.width, f.height, f.pixels);
+    }
+
+    rasteriser r(width, height, colour(gState.background),
+                 colour(gState.wireframe), colour(gState.surface),
+                 gState.multisample, gState.lighting,
+                 gState.orderIndependent, gState.depthSort);
+
+    r.order.swap(depthOrder);
+    const bool rv = render({&r}, updateMatrix);
+    r.order.swap(depthOrder);
+    if (!rv) {
+      return false;
+    }
+
+    return image::write(output, type, r.width, r.height, r.pixels);
+  }
+
 #if !defined(NO_OPENGL)
   bool opengl(bool updateMatrix = false) {
     if (metadata::update) {
@@ -298,6 +834,306 @@ public:
 #endif
 
 protected:
+  /**\brief Animation frame rate
+   *
+   * Frames per second of animated SVG output; the same as the default frame
+   * rate of video encoders for raw input, so both kinds of animation run at
+   * the same speed.
+   */
+  static const std::size_t framesPerSecond = 25;
+
+  /**\brief Chunk size
+   *
+   * Number of faces that render() collects before passing them on to its
+   * sinks.
+   */
+  static const std::size_t chunk = 1024;
+
+  /**\brief Append face to buffer
+   *
+   * Adds the coordinates of a face to a sink buffer, converting them to
+   * doubles along the way.
+   *
+   * \tparam e Dimension of the face's vertices.
+   *
+   * \param[out] buffer The buffer to append to.
+   * \param[in]  face   The face to append.
+   */
+  template <std::size_t e>
+  static void
+  append(std::vector<double> &buffer,
+         const std::array<efgy::math::vector<Q, e>,
+                          modelType::faceVertices> &face) {
+    for (const auto &v : face) {
+      for (std::size_t i = 0; i < e; i++) {
+        buffer.push_back(double(v[i]));
+      }
+    }
+  }
+
+  /**\brief Pass buffered faces to sinks
+   *
+   * Hands each sink the buffer for the dimension it asked for, along with the
+   * shading attributes if it is a 2D sink that wants them, then clears the
+   * buffers.
+   *
+   * \param[in]     sinks  The sinks to pass the faces to.
+   * \param[in]     slot   The buffer to use for each of the sinks.
+   * \param[in,out] buffer The face buffers for each dimension.
+   * \param[in]     depth  Depth of each of the faces' vertices.
+   * \param[in]     light  Light of each of the faces.
+   * \param[in]     count  The number of faces in the buffers.
+   *
+   * \returns 'true' if all the sinks accepted the faces.
+   */
+  static bool flush(const std::vector<sink *> &sinks,
+                    const std::vector<std::size_t> &slot,
+                    std::vector<double> (&buffer)[3],
+                    const std::vector<double> &depth,
+                    const std::vector<double> &light, std::size_t count) {
+    bool rv = true;
+    for (std::size_t i = 0; i < sinks.size(); i++) {
+      if (slot[i] == 2 && sinks[i]->shaded()) {
+        rv = sinks[i]->shading(depth.data(), light.data(), count) && rv;
+      }
+      rv = sinks[i]->faces(buffer[slot[i]].data(), count) && rv;
+    }
+    for (std::size_t i = 0; i < 3; i++) {
+      buffer[i].clear();
+    }
+    return rv;
+  }
+
+  /**\brief Checkpoint interval
+   *
+   * Minimum number of seconds between two flame checkpoints, not counting
+   * the ones written at sample milestones.
+   */
+  static const std::size_t checkpointInterval = 60;
+
+  /**\brief Replace file
+   *
+   * Writes a file under a temporary name, then renames it to its final name,
+   * so that readers - or a resumed render - never see a partially written
+   * file, even if the programme is killed while writing.
+   *
+   * \tparam F Function type of the writer.
+   *
+   * \param[in] path  The file to write.
+   * \param[in] write Called with the output stream; returns 'true' upon
+   *                  success.
+   *
+   * \returns 'true' if the file was written and renamed successfully.
+   */
+  template <typename F>
+  static bool replace(const std::string &path, const F &write) {
+    const std::string temporary = path + ".tmp";
+    {
+      std::ofstream out(temporary, std::ios::binary | std::ios::trunc);
+      if (!out || !write(out) || !out.flush()) {
+        std::remove(temporary.c_str());
+        return false;
+      }
+    }
+    if (std::rename(temporary.c_str(), path.c_str()) != 0) {
+      std::remove(temporary.c_str());
+      return false;
+    }
+    return true;
+  }
+
+  /**\brief Sample flame progressively
+   *
+   * Takes the number of samples set in the state object's flameSamples, one
+   * sample per pixel at a time. If flameCheckpoint is set, rendering resumes
+   * from the checkpoint in that file - provided it was written for the same
+   * state::args() - and the checkpoint is updated periodically and whenever
+   * the samples per pixel reach a power of two. At those milestones, a
+   * preview image is also written next to the checkpoint, with ".png"
+   * appended to the file name.
+   *
+   * The flame renderer keeps its sampling threads running between steps and
+   * only merges their histograms when a checkpoint or preview is written, or
+   * at the end. Checkpoints are always taken between steps, and the
+   * histograms are accumulated in integers, so a resumed render ends up with
+   * the same image as one that wasn't interrupted - as long as the stream
+   * count is the same, which load() checks.
+   *
+   * \param[in,out] f The flame renderer, with the model's faces already
+   *                  collected.
+   *
+   * \returns 'true' upon success; 'false' if a checkpoint or preview
+   *          couldn't be written.
+   */
+  bool progressive(flame &f) const {
+    const std::uint64_t step = std::uint64_t(f.width) * f.height;
+    const std::uint64_t target = step * gState.flameSamples;
+    const std::string &path = gState.flameCheckpoint;
+
+    std::string key;
+    if (!path.empty()) {
+      std::vector<std::string> v;
+      for (const auto &arg : gState.args(v)) {
+        key += (key.empty() ? "" : " ") + arg;
+      }
+
+      std::ifstream in(path, std::ios::binary);
+      if (in) {
+        f.load(in, key);
+      }
+    }
+
+    std::uint64_t milestone = step;
+    while (milestone <= f.samples) {
+      milestone *= 2;
+    }
+    auto last = std::chrono::steady_clock::now();
+
+    while (f.samples < target) {
+      f.iterate(std::min(target - f.samples, step));
+
+      if (path.empty()) {
+        continue;
+      }
+
+      const auto now = std::chrono::steady_clock::now();
+      const bool reached = f.samples >= milestone || f.samples >= target;
+      if (reached || (now - last >= std::chrono::seconds(
+                                         std::size_t(checkpointInterval)))) {
+        last = now;
+        if (!replace(path, [&f, &key](std::ostream &out)->bool {
+              return f.save(out, key);
+            })) {
+          std::cerr << "error: could not write " << path << "\n";
+          return false;
+        }
+      }
+
+      if (reached) {
+        while (milestone <= f.samples) {
+          milestone *= 2;
+        }
+        f.tonemap();
+        if (!replace(path + ".png", [&f](std::ostream &out)->bool {
+              return image::png(out, f.width, f.height, f.pixels);
+            })) {
+          std::cerr << "error: could not write " << path << ".png\n";
+          return false;
+        }
+      }
+    }
+
+    return true;
+  }
+
+  /**\brief Update cached SVG fragments
+   *
+   * Rebuilds the SVG prologue and epilogue if the model or any of the
+   * settings that go into them have changed since they were last built.
+   */
+  void header(void) {
+    const cacheKey current = settings();
+
+    if (metadata::update || prologue.empty() || (current != cachedSettings)) {
+      metadata::update = false;
+      cachedSettings = current;
+
+      std::ostringstream s("");
+      s << "<?xml version='1.0' encoding='utf-8'?>"
+           "<svg xmlns='http://www.w3.org/2000/svg'"
+           " xmlns:xlink='http://www.w3.org/1999/xlink'"
+           " version='1.1' width='100%' height='100%' viewBox='-1.2 -1.2 "
+           "2.4 2.4'>"
+           "<title>" << metadata::name()
+        << "</title>"
+           "<metadata xmlns:t='http://ef.gy/2012/topologic'>";
+      prologue = s.str();
+
+      s.str("");
+      gState.settingsMetadata(s);
+      s << "</metadata>"
+           "<style type='text/css'>svg { background: rgba("
+        << double(gState.background.red) * 100. << "%,"
+        << double(gState.background.green) * 100. << "%,"
+        << double(gState.background.blue) * 100. << "%,"
+        << double(gState.background.alpha)
+        << "); }"
+           " path { stroke-width: 0.002; stroke: rgba("
+        << double(gState.wireframe.red) * 100. << "%,"
+        << double(gState.wireframe.green) * 100. << "%,"
+        << double(gState.wireframe.blue) * 100. << "%,"
+        << double(gState.wireframe.alpha) << ");"
+                                             " fill: rgba("
+        << double(gState.surface.red) * 100. << "%,"
+        << double(gState.surface.green) * 100. << "%,"
+        << double(gState.surface.blue) * 100. << "%,"
+        << double(gState.surface.alpha) << "); }</style>";
+      epilogue = s.str();
+    }
+  }
+
+  /**\brief Cached settings
+   *
+   * The settings that go into the cached parts of the SVG output. Integer
+   * parameters and flags are kept as integers, so that e.g. two different
+   * seeds never compare equal just because they round to the same value
+   * in Q.
+   */
+  class cacheKey {
+  public:
+    /**\brief Real valued settings
+     *
+     * The colours' components, followed by the real valued model
+     * parameters.
+     */
+    std::array<Q, 16> values;
+
+    /**\brief Integer valued settings
+     *
+     * The integer model parameters, followed by the flags.
+     */
+    std::array<unsigned long long, 7> counts;
+
+    /**\brief Compare settings
+     *
+     * \param[in] b The settings to compare to.
+     *
+     * \returns 'true' if any of the settings differ.
+     */
+    bool operator!=(const cacheKey &b) const {
+      return (values != b.values) || (counts != b.counts);
+    }
+  };
+
+  /**\brief Collect cached settings
+   *
+   * Gathers all the settings that go into the cached parts of the SVG
+   * output, so they can be compared to the settings the cache was created
+   * with.
+   *
+   * \returns The current colours, model parameters and coordinate mode.
+   */
+  cacheKey settings(void) const {
+    cacheKey key;
+    key.values = {{gState.background.red, gState.background.green,
+                   gState.background.blue, gState.background.alpha,
+                   gState.wireframe.red, gState.wireframe.green,
+                   gState.wireframe.blue, gState.wireframe.alpha,
+                   gState.surface.red, gState.surface.green,
+                   gState.surface.blue, gState.surface.alpha,
+                   Q(gState.parameter.radius), Q(gState.parameter.radius2),
+                   Q(gState.parameter.constant),
+                   Q(gState.parameter.precision)}};
+    key.counts = {{(unsigned long long)gState.parameter.iterations,
+                   (unsigned long long)gState.parameter.seed,
+                   (unsigned long long)gState.parameter.functions,
+                   (unsigned long long)gState.parameter.flameCoefficients,
+                   gState.parameter.preRotate ? 1ull : 0ull,
+                   gState.parameter.postRotate ? 1ull : 0ull,
+                   gState.polarCoordinates ? 1ull : 0ull}};
+    return key;
+  }
+
   /**\brief Global state object
    *
    * A reference to the global state object, which was passed to
@@ -312,6 +1148,37 @@ protected:
    * trying to create a representation of.
    */
   modelType object;
+
+  /**\brief Cached SVG prologue
+   *
+   * Everything in the SVG output up to the camera metadata: the XML
+   * declaration, the root element, the title and the opening metadata tag.
+   * Only depends on the model, so it's built once and reused.
+   */
+  std::string prologue;
+
+  /**\brief Cached SVG epilogue
+   *
+   * Everything in the SVG output between the camera metadata and the model's
+   * paths: the settings metadata and the style sheet. Rebuilt together with
+   * the prologue whenever settings() changes or the 'update' flag is set.
+   */
+  std::string epilogue;
+
+  /**\brief Settings used for the cached SVG fragments
+   *
+   * The result of settings() at the time the prologue and epilogue were
+   * built.
+   */
+  cacheKey cachedSettings;
+
+  /**\brief Depth order of the last bitmap
+   *
+   * The order that the software rasteriser drew faces in the last time a
+   * bitmap was rendered with depth sorting, so that the next frame of an
+   * animation can start from there.
+   */
+  std::vector<std::uint32_t> depthOrder;
 };
 }
 }
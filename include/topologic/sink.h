@@ -0,0 +1,124 @@
+/**\file
+ * \brief Face sinks
+ *
+ * Most of Topologic's output formats only need to see a model's faces, one
+ * after the other, after they've been projected to some dimension. This file
+ * defines the interface for such consumers of faces, so that the model
+ * renderers can generate and project a model once and hand the result to any
+ * number of them.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#if !defined(TOPOLOGIC_SINK_H)
+#define TOPOLOGIC_SINK_H
+
+#include <cstddef>
+#include <string>
+
+namespace topologic {
+namespace render {
+/**\brief Face sink
+ *
+ * Base class for anything that consumes a model's faces. A renderer first
+ * calls begin() with the layout of the faces it is about to produce, then
+ * calls faces() with chunks of faces as they are generated, then calls end().
+ *
+ * Coordinates are passed as doubles regardless of the renderer's base data
+ * type, which is lossless for both float and double, so sinks don't need to
+ * be templates just to be usable with either.
+ */
+class sink {
+public:
+  /**\brief Virtual destructor
+   *
+   * Generally necessary for virtual classes; stubbed to be a
+   * trivial destructor.
+   */
+  virtual ~sink(void) {}
+
+  /**\brief Requested dimension
+   *
+   * Tells the renderer which dimension the sink wants to see faces in.
+   * Renderers support '3' and '2' - the faces after all projections down to
+   * 3D or 2D, respectively - and '0', which means the model's render depth,
+   * before any projections.
+   *
+   * \returns The dimension that faces should be projected to.
+   */
+  virtual std::size_t dimension(void) const = 0;
+
+  /**\brief Start of model
+   *
+   * Called before any faces are passed to the sink.
+   *
+   * \param[in] name         Name of the model, e.g. "4-cube".
+   * \param[in] dimension    Number of coordinates per vertex.
+   * \param[in] faceVertices Number of vertices per face.
+   *
+   * \returns 'true' if the sink is ready to receive faces.
+   */
+  virtual bool begin(const std::string &name, std::size_t dimension,
+                     std::size_t faceVertices) = 0;
+
+  /**\brief Chunk of faces
+   *
+   * Passes a number of faces to the sink. The coordinates are packed, face
+   * by face, vertex by vertex, so there are 'count * faceVertices *
+   * dimension' of them, with the values given to begin().
+   *
+   * \param[in] coordinates The coordinates of the faces.
+   * \param[in] count       The number of faces.
+   *
+   * \returns 'true' if the sink wants more faces, 'false' on errors.
+   */
+  virtual bool faces(const double *coordinates, std::size_t count) = 0;
+
+  /**\brief Wants shading attributes?
+   *
+   * Sinks that ask for 2D faces can also ask for the information needed to
+   * draw them with depth testing and lighting, which is lost in the final
+   * projection to 2D. Renderers then call shading() before every call to
+   * faces().
+   *
+   * \returns 'true' if shading() should be called; the default is 'false'.
+   */
+  virtual bool shaded(void) const { return false; }
+
+  /**\brief Shading attributes of a chunk of faces
+   *
+   * Called right before faces(), with the same number of faces, if shaded()
+   * returned 'true'. Both values are taken in the 3D level, after its affine
+   * transformation but before its projection to 2D.
+   *
+   * \param[in] depth Distance of each vertex from the 3D camera, face by
+   *                  face; there are 'count * faceVertices' of these.
+   * \param[in] light How directly each face faces the camera, from 0 for
+   *                  faces seen edge-on to 1 for faces seen head-on; there
+   *                  are 'count' of these.
+   * \param[in] count The number of faces.
+   *
+   * \returns 'true' upon success.
+   */
+  virtual bool shading(const double *, const double *, std::size_t) {
+    return true;
+  }
+
+  /**\brief End of model
+   *
+   * Called after all of the model's faces have been passed to the sink.
+   *
+   * \returns 'true' upon success.
+   */
+  virtual bool end(void) = 0;
+};
+}
+}
+
+#endif
@@ -76,7 +76,66 @@ enum outputMode {
    * Output is supposed to be a set of arguments, which could be passed to the
    * command line topologic binary.
    */
-  outArguments = 5
+  outArguments = 5,
+
+  /**\brief Binary glTF label
+   *
+   * Produces a binary glTF (GLB) file with the model projected to 3D, which
+   * clients can upload to a GPU without having to parse anything. The state
+   * metadata is embedded in the file as JSON.
+   */
+  outGLB = 6,
+
+  /**\brief Raw geometry label
+   *
+   * Streams the model's faces in the model's render depth, before any
+   * projections, as packed little endian floating point numbers. Meant for
+   * other programmes that want to memory-map the geometry.
+   */
+  outRaw = 7,
+
+  /**\brief JSON with geometry label
+   *
+   * Like the plain JSON output, but with the model's faces - projected to
+   * 3D - appended to the metadata as flat coordinate arrays.
+   */
+  outJSONGeometry = 8,
+
+  /**\brief JSON with raw geometry label
+   *
+   * Like outJSONGeometry, but the faces are written in the model's render
+   * depth, before any projections.
+   */
+  outJSONRawGeometry = 9,
+
+  /**\brief PNG bitmap label
+   *
+   * Rasterises the model in software, without needing a GPU, and writes the
+   * result as a PNG image at the state's width and height.
+   */
+  outPNG = 10,
+
+  /**\brief PPM bitmap label
+   *
+   * Like outPNG, but writes a binary PPM image, which is easier for other
+   * programmes to consume.
+   */
+  outPPM = 11,
+
+  /**\brief Raw RGBA frames label
+   *
+   * Rasterises the model like outPNG, once per animation frame, and writes
+   * the frames' pixels back to back without any headers, so the output can
+   * be piped straight into a video encoder.
+   */
+  outRGBA = 12,
+
+  /**\brief Animated SVG label
+   *
+   * Renders the model once per animation frame, like outRGBA, but writes a
+   * single SVG in which the faces are animated with SMIL.
+   */
+  outSVGAnimation = 13
 };
 
 /**\brief Topologic global programme state object
@@ -324,6 +383,20 @@ public:
     return true;
   }
 
+  /**\brief Advance animation
+   *
+   * Moves the camera on to the next frame of an animation, by applying each
+   * of the drags in the 'motion' setting once.
+   *
+   * \note Drags in dimensions higher than this state object's are ignored.
+   */
+  void advance(void) {
+    for (const auto &m : state<Q, 1>::motion) {
+      setActive(std::size_t(m[0]));
+      interpretDrag(m[1], m[2], 0);
+    }
+  }
+
   /**\brief Set active dimension
    *
    * Some of the functions that modify the global state rely on a
@@ -565,6 +638,54 @@ public:
     return value;
   }
 
+  /**\brief Write camera metadata
+   *
+   * Writes the XML metadata for this dimension's camera and transformation
+   * matrix, then does the same for all the lower dimensions. These are the
+   * parts of the metadata that typically change between animation frames;
+   * everything else is written by settingsMetadata().
+   *
+   * \param[out] stream The stream to write to.
+   *
+   * \returns The stream that was passed in.
+   *
+   * \tparam C Character type for the basic_ostream reference.
+   */
+  template <typename C>
+  std::basic_ostream<C> &cameraMetadata(std::basic_ostream<C> &stream) const {
+    stream << "<t:camera";
+    if (base::polarCoordinates) {
+      stream << " radius='" << double(fromp[0]) << "'";
+      for (std::size_t i = 1; i < d; i++) {
+        stream << " theta-" << i << "='" << double(fromp[i]) << "'";
+      }
+    } else {
+      for (std::size_t i = 0; i < d; i++) {
+        if (i < sizeof(cartesianDimensions)) {
+          stream << " " << cartesianDimensions[i] << "='" << double(from[i])
+                 << "'";
+        } else {
+          stream << " d-" << i << "='" << double(from[i]) << "'";
+        }
+      }
+    }
+    stream << "/>";
+    stream << "<t:transformation";
+    if (isIdentity(transformation.matrix)) {
+      stream << " matrix='identity' depth='" << d << "'";
+    } else {
+      for (std::size_t i = 0; i <= d; i++) {
+        for (std::size_t j = 0; j <= d; j++) {
+          stream << " e" << i << "-" << j << "='"
+                 << double(transformation.matrix[i][j]) << "'";
+        }
+      }
+    }
+    stream << "/>";
+
+    return state<Q, d - 1>::cameraMetadata(stream);
+  }
+
 protected:
   /**\brief Is this the currently active dimension?
    *
@@ -603,8 +724,10 @@ public:
         opengl(),
 #endif
         background(Q(1), Q(1), Q(1), Q(1)), wireframe(Q(0), Q(0), Q(0), Q(0.8)),
-        surface(Q(0), Q(0), Q(0), Q(0.2)), fractalFlameColouring(false),
-        model(0) {
+        surface(Q(0), Q(0), Q(0), Q(0.2)), width(Q(512)), height(Q(512)),
+        multisample(4), lighting(false), orderIndependent(false),
+        depthSort(false), flameSamples(32), frames(1),
+        fractalFlameColouring(false), model(0) {
     parameter.radius = Q(1);
     parameter.precision = Q(10);
     parameter.iterations = 4;
@@ -878,6 +1001,63 @@ public:
     return value;
   }
 
+  /**\brief Write camera metadata (1D fix point)
+   *
+   * There is no camera in 1D, so this doesn't write anything.
+   *
+   * \param[out] stream The stream to write to.
+   *
+   * \returns The stream that was passed in.
+   */
+  template <typename C>
+  std::basic_ostream<C> &cameraMetadata(std::basic_ostream<C> &stream) const {
+    return stream;
+  }
+
+  /**\brief Write settings metadata
+   *
+   * Writes the XML metadata for all the settings that apply to all
+   * dimensions: the camera mode, the model, its parameters and the colours.
+   *
+   * \param[out] stream The stream to write to.
+   *
+   * \returns The stream that was passed in.
+   *
+   * \tparam C Character type for the basic_ostream reference.
+   */
+  template <typename C>
+  std::basic_ostream<C> &settingsMetadata(std::basic_ostream<C> &stream) const {
+    stream << "<t:camera mode='" << (polarCoordinates ? "polar" : "cartesian")
+           << "'/>";
+    if (model) {
+      stream << "<t:model type='" << model->id << "' depth='" << model->depth
+             << "D' render-depth='" << model->renderDepth
+             << "D'/>"
+                "<t:coordinates format='" << model->formatID << "'/>";
+    }
+    stream << "<t:options radius='" << double(parameter.radius) << "'/>"
+           << "<t:precision polar='" << double(parameter.precision) << "'/>"
+           << "<t:ifs iterations='" << parameter.iterations << "' seed='"
+           << parameter.seed << "' functions='" << parameter.functions
+           << "' pre-rotate='" << (parameter.preRotate ? "yes" : "no")
+           << "' post-rotate='" << (parameter.postRotate ? "yes" : "no")
+           << "'/>"
+           << "<t:flame coefficients='" << parameter.flameCoefficients << "'/>"
+           << "<t:colour-background red='" << double(background.red)
+           << "' green='" << double(background.green) << "' blue='"
+           << double(background.blue) << "' alpha='" << double(background.alpha)
+           << "'/>"
+           << "<t:colour-wireframe red='" << double(wireframe.red)
+           << "' green='" << double(wireframe.green) << "' blue='"
+           << double(wireframe.blue) << "' alpha='" << double(wireframe.alpha)
+           << "'/>"
+           << "<t:colour-surface red='" << double(surface.red) << "' green='"
+           << double(surface.green) << "' blue='" << double(surface.blue)
+           << "' alpha='" << double(surface.alpha) << "'/>";
+
+    return stream;
+  }
+
   /**\brief Model renderer instance
    *
    * Points to an instance of a model renderer, e.g.
@@ -956,6 +1136,81 @@ public:
    */
   Q height;
 
+  /**\brief Multisampling
+   *
+   * Number of samples per pixel that the software rasteriser uses for
+   * antialiasing; 1, 4 or 8.
+   *
+   * \note Only applies to bitmap output; the OpenGL renderer uses whatever
+   *       the frontend's context was set up with.
+   */
+  std::size_t multisample;
+
+  /**\brief Shade surfaces?
+   *
+   * 'true' if the software rasteriser should depth test faces and light them
+   * the way the OpenGL renderer does, instead of drawing them in the order
+   * they were generated, like the SVG output.
+   *
+   * \note Only applies to bitmap output.
+   */
+  bool lighting;
+
+  /**\brief Order independent transparency?
+   *
+   * 'true' if the software rasteriser should blend translucent surfaces and
+   * outlines so that the result doesn't depend on the order that faces are
+   * generated in, instead of compositing them in that order.
+   *
+   * \note Only applies to bitmap output.
+   */
+  bool orderIndependent;
+
+  /**\brief Sort faces by depth?
+   *
+   * 'true' if the software rasteriser should draw faces from back to front,
+   * so that translucent surfaces are composited correctly. In animations,
+   * the order of each frame is reused for the next one.
+   *
+   * \note Only applies to bitmap output; ignored with order independent
+   *       transparency.
+   */
+  bool depthSort;
+
+  /**\brief Fractal flame samples
+   *
+   * Number of samples per pixel that the CPU fractal flame renderer takes;
+   * more samples make for smoother images, but take longer to render.
+   *
+   * \note Only applies to bitmap output with fractal flame colouring.
+   */
+  std::size_t flameSamples;
+
+  /**\brief Fractal flame checkpoint
+   *
+   * File that the CPU fractal flame renderer periodically saves its progress
+   * to, and resumes from if the file was written for the same settings. A
+   * preview image is kept next to it, with ".png" appended to the name. No
+   * checkpoints are written if this is empty.
+   *
+   * \note Only applies to bitmap output with fractal flame colouring.
+   */
+  std::string flameCheckpoint;
+
+  /**\brief Animation frames
+   *
+   * Number of frames to render for animated output; 1 by default.
+   */
+  std::size_t frames;
+
+  /**\brief Animation motion
+   *
+   * Applied before every frame of animated output except the first. Each
+   * step is a dimension, and a horizontal and vertical drag that is applied
+   * to that dimension with interpretDrag().
+   */
+  std::vector<std::array<Q, 3>> motion;
+
   /**\brief Use fractal frame colouring?
    *
    * 'true' if renderers should render images using the fractal flame
@@ -972,9 +1227,9 @@ public:
 /**\brief Gather model metadata
  *
  * Creates an XML fragment containing all of the settings in this instance
- * of the global state object. Will call its parent class's metadata method
- * as well, which will do the same recursively until finally the 1D fix
- * point method is called.
+ * of the global state object: the camera metadata of every dimension, as
+ * written by state::cameraMetadata(), followed by the settings that apply to
+ * all dimensions, as written by state::settingsMetadata().
  *
  * \param[out] stream The XML stream to write to.
  * \param[in]  pState The state to serialise.
@@ -989,38 +1244,9 @@ public:
 template <typename C, typename Q, std::size_t d>
     static inline efgy::xml::ostream<C> operator<<(efgy::xml::ostream<C> stream,
                                                    const state<Q, d> &pState) {
-  stream.stream << "<t:camera";
-  if (pState.polarCoordinates) {
-    stream.stream << " radius='" << double(pState.fromp[0]) << "'";
-    for (std::size_t i = 1; i < d; i++) {
-      stream.stream << " theta-" << i << "='" << double(pState.fromp[i]) << "'";
-    }
-  } else {
-    for (std::size_t i = 0; i < d; i++) {
-      if (i < sizeof(cartesianDimensions)) {
-        stream.stream << " " << cartesianDimensions[i] << "='"
-                      << double(pState.from[i]) << "'";
-      } else {
-        stream.stream << " d-" << i << "='" << double(pState.from[i]) << "'";
-      }
-    }
-  }
-  stream.stream << "/>";
-  stream.stream << "<t:transformation";
-  if (isIdentity(pState.transformation.matrix)) {
-    stream.stream << " matrix='identity' depth='" << d << "'";
-  } else {
-    for (std::size_t i = 0; i <= d; i++) {
-      for (std::size_t j = 0; j <= d; j++) {
-        stream.stream
-            << " e" << i << "-" << j << "='"
-            << double(pState.transformation.matrix[i][j]) << "'";
-      }
-    }
-  }
-  stream.stream << "/>";
-
-  return operator<< <C, Q, d - 1>(stream, pState);
+  pState.cameraMetadata(stream.stream);
+  pState.settingsMetadata(stream.stream);
+  return stream;
 }
 
 /**\brief Gather model metadata (1D fix point)
@@ -1042,38 +1268,7 @@ template <typename C, typename Q, std::size_t d>
 template <typename C, typename Q, std::size_t d>
     static inline efgy::xml::ostream<C> operator<<(efgy::xml::ostream<C> stream,
                                                    const state<Q, 1> &pState) {
-  stream.stream << "<t:camera mode='"
-                << (pState.polarCoordinates ? "polar" : "cartesian") << "'/>";
-  if (pState.model) {
-    stream.stream << "<t:model type='" << pState.model->id << "' depth='"
-                  << pState.model->depth << "D' render-depth='"
-                  << pState.model->renderDepth << "D'/>"
-                                                  "<t:coordinates format='"
-                  << pState.model->formatID << "'/>";
-  }
-  stream.stream
-      << "<t:options radius='" << double(pState.parameter.radius) << "'/>"
-      << "<t:precision polar='" << double(pState.parameter.precision) << "'/>"
-      << "<t:ifs iterations='" << pState.parameter.iterations << "' seed='"
-      << pState.parameter.seed << "' functions='" << pState.parameter.functions
-      << "' pre-rotate='" << (pState.parameter.preRotate ? "yes" : "no")
-      << "' post-rotate='" << (pState.parameter.postRotate ? "yes" : "no")
-      << "'/>"
-      << "<t:flame coefficients='" << pState.parameter.flameCoefficients
-      << "'/>"
-      << "<t:colour-background red='" << double(pState.background.red)
-      << "' green='" << double(pState.background.green) << "' blue='"
-      << double(pState.background.blue) << "' alpha='"
-      << double(pState.background.alpha) << "'/>"
-      << "<t:colour-wireframe red='" << double(pState.wireframe.red)
-      << "' green='" << double(pState.wireframe.green) << "' blue='"
-      << double(pState.wireframe.blue) << "' alpha='"
-      << double(pState.wireframe.alpha) << "'/>"
-      << "<t:colour-surface red='" << double(pState.surface.red) << "' green='"
-      << double(pState.surface.green) << "' blue='"
-      << double(pState.surface.blue) << "' alpha='"
-      << double(pState.surface.alpha) << "'/>";
-
+  pState.settingsMetadata(stream.stream);
   return stream;
 }
 
@@ -0,0 +1,42 @@
+/**\ingroup topologic-frontend
+ * \defgroup frontend-egl Headless OpenGL frontend
+ * \brief Command line Topologic frontend using OpenGL without a window
+ *
+ * A variant of the CLI frontend that renders bitmaps with the OpenGL renderer
+ * of the graphical frontends, using an offscreen EGL context. This makes it
+ * possible to use the real OpenGL pipeline - including fractal flame
+ * colouring - on servers without a display, e.g. with Mesa's llvmpipe.
+ *
+ * \{
+ */
+
+/**\file
+ * \brief Topologic/EGL frontend
+ *
+ * A command line application that renders PNG, PPM or raw RGBA images with
+ * OpenGL and writes them to stdout.
+ *
+ * \copyright
+ * This file is part of the Topologic project, which is released as open source
+ * under the terms of an MIT/X11-style licence, described in the COPYING file.
+ *
+ * \see Project Documentation: http://ef.gy/documentation/topologic
+ * \see Project Source Code: https://github.com/ef-gy/topologic
+ * \see Licence Terms: https://github.com/ef-gy/topologic/blob/master/COPYING
+ */
+
+#include <topologic/egl.h>
+
+/**\brief Topologic/EGL main function
+ *
+ * This is really just a stub that calls the topologic::egl function, which
+ * contains the actual logic for the Topologic/EGL frontend.
+ *
+ * \param[in] argc The number of arguments in the argv array.
+ * \param[in] argv The actual command line arguments passed to the programme.
+ *
+ * \returns 0 on success, nonzero otherwise.
+ */
+int main(int argc, char *argv[]) { return topologic::egl<double>(argc, argv); }
+
+/** \} */